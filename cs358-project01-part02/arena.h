@@ -0,0 +1,188 @@
+/*arena.h*/
+
+//
+// Arena allocation for the traversal's own containers (queues, the vertex
+// id map), so the hot loop doesn't go to the global heap, and threads
+// don't fight over malloc's locks.
+//
+// An Arena carves blocks out of slabs (64KB by default) with a bump
+// pointer. Sizes are rounded up to a power of 2 (16 bytes .. 8KB, or the
+// slab size if smaller), and a freed block goes on a free list for its
+// size, so a container that grows and shrinks (a deque's chunks, a hash
+// map's nodes) reuses its own blocks rather than taking new ones. Bigger
+// blocks (rare: a hash map's bucket array, say) go straight to the heap.
+// Slabs are only returned when the arena is destroyed, in bulk.
+//
+// An Arena is NOT thread-safe: each one belongs to an owner (a thread, or
+// a lock) and is only used by it, e.g. a thread's queue is only touched
+// under that queue's lock, so its arena is too.
+//
+// ArenaAllocator<T> is a standard allocator over an Arena, for containers:
+//
+//   std::deque<int, ArenaAllocator<int>> q(ArenaAllocator<int>(&arena));
+//
+// Every arena counts its allocations, and how many of them needed the
+// heap, see ArenaStats.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+struct ArenaStats {
+  long allocations = 0;   // blocks handed out
+  long bytes = 0;         // bytes requested
+  long reused = 0;        // ... of which came off a free list
+  long heap_calls = 0;    // slabs and large blocks taken from the heap
+  long heap_bytes = 0;
+
+  ArenaStats& operator+=(const ArenaStats& other)
+  {
+    allocations += other.allocations;
+    bytes += other.bytes;
+    reused += other.reused;
+    heap_calls += other.heap_calls;
+    heap_bytes += other.heap_bytes;
+    return *this;
+  }
+};
+
+class alignas(64) Arena {
+    public:
+
+      explicit Arena(size_t slabSize = 64 * 1024)
+        : slab_size(slabSize), cur(nullptr), end(nullptr)
+      {
+        for (int c = 0; c < CLASSES; c++)
+          free_lists[c] = nullptr;
+      }
+
+      ~Arena()
+      {
+        for (char* slab : slabs)
+          ::operator delete(slab);
+      }
+
+      Arena(const Arena&) = delete;
+      Arena& operator=(const Arena&) = delete;
+
+      //
+      // allocate: a block of at least bytes, aligned for any type:
+      //
+      void* allocate(size_t bytes)
+      {
+        counts.allocations++;
+        counts.bytes += bytes;
+
+        int c = size_class(bytes);
+
+        if (c < 0)  // too big for a slab block:
+        {
+          counts.heap_calls++;
+          counts.heap_bytes += bytes;
+          return ::operator new(bytes);
+        }
+
+        if (free_lists[c] != nullptr)
+        {
+          Free* block = free_lists[c];
+          free_lists[c] = block->next;
+          counts.reused++;
+          return block;
+        }
+
+        size_t size = MIN_BLOCK << c;
+
+        if (cur + size > end)
+          new_slab();
+
+        void* block = cur;
+        cur += size;
+        return block;
+      }
+
+      //
+      // deallocate: returns a block from allocate(bytes) to its free list:
+      //
+      void deallocate(void* p, size_t bytes)
+      {
+        int c = size_class(bytes);
+
+        if (c < 0)
+        {
+          ::operator delete(p);
+          return;
+        }
+
+        Free* block = static_cast<Free*>(p);
+        block->next = free_lists[c];
+        free_lists[c] = block;
+      }
+
+      const ArenaStats& stats() const { return counts; }
+
+    private:
+
+      static const size_t MIN_BLOCK = 16;
+      static const int    CLASSES = 10;          // 16 bytes .. 8KB
+
+      struct Free { Free* next; };
+
+      // size_class: c such that the block is MIN_BLOCK << c, -1 if too big
+      int size_class(size_t bytes) const
+      {
+        int c = 0;
+        while ((MIN_BLOCK << c) < bytes)
+          if (++c == CLASSES)
+            return -1;
+        return ((MIN_BLOCK << c) <= slab_size) ? c : -1;
+      }
+
+      // new_slab: takes a fresh slab from the heap (what's left of the
+      // current one is abandoned):
+      void new_slab()
+      {
+        slabs.push_back(static_cast<char*>(::operator new(slab_size)));
+        counts.heap_calls++;
+        counts.heap_bytes += slab_size;
+
+        cur = slabs.back();
+        end = cur + slab_size;
+      }
+
+      size_t             slab_size;
+      std::vector<char*> slabs;
+      char*              cur;   // bump pointer into the current slab
+      char*              end;
+      Free*              free_lists[CLASSES];
+      ArenaStats         counts;
+};
+
+
+//
+// ArenaAllocator: the standard allocator interface over an Arena.
+//
+template <class T> struct ArenaAllocator {
+  typedef T value_type;
+
+  Arena* arena;
+
+  explicit ArenaAllocator(Arena* a) : arena(a) { }
+
+  template <class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) { }
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T*>(arena->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n)
+  {
+    arena->deallocate(p, n * sizeof(T));
+  }
+
+  template <class U> bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+  template <class U> bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
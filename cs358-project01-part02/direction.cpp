@@ -0,0 +1,218 @@
+/*direction.cpp*/
+
+//
+// Direction-optimizing traversal of a WorkGraph, see traversal.h.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+
+#include "traversal.h"
+#include "vertexids.h"
+#include "trace.h"
+
+using namespace std;
+
+
+//
+// directionWork:
+//
+// Level-synchronous like frontierWork, but each level runs in one of two
+// directions:
+//
+//   top-down:  every neighbor returned by do_work is probed against the
+//              visited set as soon as it's returned.
+//
+//   bottom-up: the classic algorithm sweeps the unvisited vertices and looks
+//              for a parent in the frontier. A WorkGraph can't support that
+//              literally --- ids are random, so unvisited vertices are unknown
+//              until some edge names them, and only out-edges of solved
+//              vertices are known. What we can do is sweep from the other
+//              side of the count: we know how many vertices are still
+//              undiscovered (num_vertices() - discovered). So the level's
+//              neighbors are only cached during do_work, hash-partitioned
+//              by vertex id, one partition per thread. After the level,
+//              each thread gathers its partition from every thread, sorts
+//              and dedups it --- so a vertex named by several threads is
+//              still probed once --- and probes (interns, see vertexids.h)
+//              once per distinct vertex, stopping altogether as soon as
+//              the undiscovered count hits 0.
+//
+//              No adjacency is kept beyond the level (e.g. as CSR): a
+//              vertex's out-edges are only needed in the level that solves
+//              it, since it's never solved again, so the per-level
+//              partitions are the whole cache.
+//
+// Top-down is better while the frontier is small and most neighbors are
+// new; once the frontier is large relative to what's left undiscovered, most
+// probes would only confirm "already visited", so we switch to bottom-up.
+// As in Beamer et al., the switch happens when frontier * ALPHA exceeds the
+// undiscovered count.
+//
+void directionWork(WorkGraph& wg, int numThreads) {
+
+	const int ALPHA = 14;
+
+	struct ThreadState {
+		vector<vector<int>> parts;       // bottom-up: neighbor ids found by this thread, by partition
+		vector<int>         candidates;  // bottom-up: this thread's partition, from every thread
+		vector<int>         discovered;  // vertices (indices) this thread discovered
+		long                edges = 0;   // neighbors returned by do_work this level
+		long                probes = 0;  // visited-set probes this level
+	};
+
+	struct LevelStats {
+		bool   bottom_up;
+		size_t size;
+		long   edges;
+		long   probes;
+	};
+
+	int num_vertices = wg.num_vertices();
+
+	VertexIds ids(num_vertices);
+	vector<ThreadState> state;  // one per thread of the team, see below
+	vector<LevelStats> levels;
+
+	auto part_of = [](int id, int nt) {
+		unsigned h = (unsigned) id * 2654435761u;  // as in vertexids.h
+		return (int) ((h >> 16) % nt);
+	};
+
+	vector<int> current;  // dense vertex indices
+	bool fresh;
+
+	current.push_back(ids.intern(wg.start_vertex(), fresh));
+
+	while (!current.empty()) {
+
+		long undiscovered = num_vertices - ids.size();
+		bool bottom_up = ((long) current.size() * ALPHA > undiscovered);
+		int team = 0;  // # of threads we actually got
+
+		#pragma omp parallel num_threads(numThreads)
+		{
+			int tid = omp_get_thread_num();
+			int nt = omp_get_num_threads();
+
+			//
+			// the team may be smaller than numThreads, so size the per-thread
+			// state from the team, and collect from that many threads below:
+			//
+			#pragma omp single
+			{
+				team = nt;
+				if ((int) state.size() < nt)
+					state.resize(nt);
+			}
+			// (implicit barrier: state is sized)
+
+			ThreadState& mine = state[tid];
+
+			mine.parts.resize(nt);
+			for (vector<int>& part : mine.parts)
+				part.clear();
+			mine.discovered.clear();
+			mine.edges = 0;
+			mine.probes = 0;
+
+			#pragma omp for schedule(dynamic, 1)
+			for (size_t i = 0; i < current.size(); i++) {
+
+				double trace_start = Trace::Now();
+
+				vector<int> neighbors = wg.do_work(ids.id_of(current[i]));
+				Trace::Record(tid, "do_work", trace_start, Trace::Now(), "vertex", ids.id_of(current[i]));
+
+				mine.edges += neighbors.size();
+
+				if (bottom_up) {
+					for (int n : neighbors)
+						mine.parts[part_of(n, nt)].push_back(n);
+				}
+				else {
+					for (int n : neighbors) {
+						bool is_new;
+						int index = ids.intern(n, is_new);
+
+						mine.probes++;
+						if (is_new)  // true => we discovered it
+							mine.discovered.push_back(index);
+					}
+				}
+			}
+			// (implicit barrier: every vertex in the level is solved)
+
+			if (bottom_up) {
+				vector<int>& candidates = mine.candidates;
+
+				candidates.clear();
+				for (int t = 0; t < nt; t++)
+					candidates.insert(candidates.end(), state[t].parts[tid].begin(), state[t].parts[tid].end());
+
+				sort(candidates.begin(), candidates.end());
+				candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+				for (int n : candidates) {
+					if (ids.size() == num_vertices)  // nothing left to find
+						break;
+
+					bool is_new;
+					int index = ids.intern(n, is_new);
+
+					mine.probes++;
+					if (is_new)
+						mine.discovered.push_back(index);
+				}
+			}
+		}
+
+		//
+		// collect the next frontier and the stats:
+		//
+		LevelStats stats;
+		stats.bottom_up = bottom_up;
+		stats.size = current.size();
+		stats.edges = 0;
+		stats.probes = 0;
+
+		current.clear();
+
+		for (int t = 0; t < team; t++) {
+			ThreadState& s = state[t];
+
+			current.insert(current.end(), s.discovered.begin(), s.discovered.end());
+
+			stats.edges += s.edges;
+			stats.probes += s.probes;
+		}
+
+		levels.push_back(stats);
+
+		cout << (bottom_up ? "^" : "v");
+		cout.flush();
+	}
+
+	long total_edges = 0, total_probes = 0;
+
+	cout << endl;
+	cout << endl;
+	cout << "level  direction   frontier      edges     probes" << endl;
+
+	for (size_t l = 0; l < levels.size(); l++) {
+		cout << setw(5) << l
+		     << setw(11) << (levels[l].bottom_up ? "bottom-up" : "top-down")
+		     << setw(11) << levels[l].size
+		     << setw(11) << levels[l].edges
+		     << setw(11) << levels[l].probes
+		     << endl;
+
+		total_edges += levels[l].edges;
+		total_probes += levels[l].probes;
+	}
+
+	cout << "visited-set probes: " << total_probes << " for " << total_edges << " edges" << endl;
+}
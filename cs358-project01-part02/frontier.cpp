@@ -0,0 +1,130 @@
+/*frontier.cpp*/
+
+//
+// Level-synchronous (BFS frontier) traversal of a WorkGraph, see
+// traversal.h.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <omp.h>
+
+#include "traversal.h"
+#include "vertexids.h"
+#include "trace.h"
+
+using namespace std;
+
+
+//
+// frontierWork:
+//
+// The current frontier is solved with a parallel for. Each vertex costs a
+// random amount of time, so vertices are handed out dynamically one at a
+// time. Neighbors are deduplicated by interning them (see vertexids.h), and
+// the ones a thread discovers go into that thread's own next-frontier buffer,
+// so there is no shared queue. At the end of the level the buffers are
+// concatenated into the next frontier.
+//
+// For each level we record the frontier size, the time, and the imbalance:
+// the busiest thread's time over the average thread's time (1.0 is
+// perfect). These are printed once the traversal is over.
+//
+void frontierWork(WorkGraph& wg, int numThreads) {
+
+	struct LevelStats {
+		size_t size;
+		double secs;
+		double imbalance;
+	};
+
+	VertexIds ids(wg.num_vertices());
+	vector<int> current, next;  // dense vertex indices
+	vector<vector<int>> discovered(numThreads);  // per-thread next-frontier buffers
+	vector<double> busy(numThreads);
+	vector<LevelStats> levels;
+
+	bool fresh;
+	current.push_back(ids.intern(wg.start_vertex(), fresh));
+
+	while (!current.empty()) {
+
+		auto level_start = chrono::high_resolution_clock::now();
+
+		#pragma omp parallel num_threads(numThreads)
+		{
+			int tid = omp_get_thread_num();
+			vector<int>& mine = discovered[tid];
+
+			mine.clear();
+			auto thread_start = chrono::high_resolution_clock::now();
+
+			#pragma omp for schedule(dynamic, 1) nowait
+			for (size_t i = 0; i < current.size(); i++) {
+
+				double trace_start = Trace::Now();
+
+				vector<int> neighbors = wg.do_work(ids.id_of(current[i]));
+				Trace::Record(tid, "do_work", trace_start, Trace::Now(), "vertex", ids.id_of(current[i]));
+
+				for (int n : neighbors) {
+					bool is_new;
+					int index = ids.intern(n, is_new);
+
+					if (is_new)  // true => we discovered it
+						mine.push_back(index);
+				}
+			}
+
+			auto thread_stop = chrono::high_resolution_clock::now();
+			busy[tid] = chrono::duration<double>(thread_stop - thread_start).count();
+		}
+
+		auto level_stop = chrono::high_resolution_clock::now();
+		Trace::IdleUntil(Trace::Now());  // waiting at the end of the level
+
+		//
+		// stats for this level:
+		//
+		double total = 0.0, most = 0.0;
+		for (int t = 0; t < numThreads; t++) {
+			total += busy[t];
+			most = max(most, busy[t]);
+		}
+
+		LevelStats stats;
+		stats.size = current.size();
+		stats.secs = chrono::duration<double>(level_stop - level_start).count();
+		stats.imbalance = (total > 0.0) ? most / (total / numThreads) : 1.0;
+		levels.push_back(stats);
+
+		//
+		// next frontier = concatenation of the per-thread buffers:
+		//
+		next.clear();
+		for (int t = 0; t < numThreads; t++)
+			next.insert(next.end(), discovered[t].begin(), discovered[t].end());
+
+		current.swap(next);
+
+		cout << ".";
+		cout.flush();
+	}
+
+	cout << endl;
+	cout << endl;
+	cout << "level   frontier       secs  imbalance" << endl;
+
+	for (size_t l = 0; l < levels.size(); l++) {
+		cout << setw(5) << l
+		     << setw(11) << levels[l].size
+		     << setw(11) << fixed << setprecision(3) << levels[l].secs
+		     << setw(11) << setprecision(2) << levels[l].imbalance
+		     << endl;
+	}
+
+	cout << defaultfloat << setprecision(6);
+}
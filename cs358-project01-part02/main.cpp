@@ -7,7 +7,7 @@
 // dynamic solution is needed.
 // 
 // Usage:
-//   work [-?] [-t NumThreads]
+//   work [-?] [-t NumThreads] [-mode steal|frontier|direction|priority|pipeline] [-bind compact|spread|cores|list:CPUS|none] [-trace file.json] [-checkpoint file] [-resume]
 //
 // Author:
 //   theo maurino
@@ -26,12 +26,12 @@
 #include <random>
 #include <sys/sysinfo.h>
 #include <omp.h>
-#include <set>
-#include <queue>
-#include <atomic>
-#include <mutex>
 
 #include "workgraph.h"
+#include "traversal.h"
+#include "affinity.h"
+#include "trace.h"
+#include "checkpoint.h"
 
 using namespace std;
 
@@ -40,132 +40,16 @@ using namespace std;
 // Globals:
 //
 static int _numThreads = 1;  // default to sequential execution
+static string _mode = "steal";  // traversal engine, see traversal.h
+static string _traceFile = "";  // Chrome trace output, if any
+static string _checkpointFile = "";  // periodic checkpoints, if any (steal mode)
+static bool _resume = false;  // start from the checkpoint?
 
 //
 // Function prototypes:
 //
 static void ProcessCmdLineArgs(int argc, char* argv[]);
 
-void parallelWork(WorkGraph& wg) {
-
-	// ok we want to
-		// distribute work early
-		// give each thread a local queue to work thru, which they can refresh atomically to get more tasks
-		// only synchronize when necessary (visited set, next queue)
-
-		// i think we want threads to be able to steal work from other threads if they finish earlu (thats the dynamic of it)
-
-	std::queue<int> global_q;
-	std::set<int> visited;
-	std::vector<std::queue<int>> local_queues(_numThreads); // make one local q per rthread
-	std::vector<std::mutex> q_mutexes(_numThreads);
-
-	// std::atomic_flag lock = ATOMIC_FLAG_INIT; // may not need
-	std::atomic<bool> done(false);
-	// bool done(false);
-	std::mutex visited_lock;
-	std::atomic<int> work_counter(0);
-
-	int start_v = wg.start_vertex();
-
-	{
-		std::lock_guard<std::mutex> lock_visited(visited_lock);
-		visited.insert(start_v);
-	}
-	{
-		std::lock_guard<std::mutex> lock_queue(q_mutexes[0]); // do i have to init this?
-		local_queues[0].push(start_v);
-		work_counter++;
-	}
-
-	#pragma omp parallel num_threads(_numThreads)
-	{
-		int tid = omp_get_thread_num();
-
-		// if (tid == 0) {
-
-		// }
-
-		while (!done) {
-			// go thru the local queue first obv
-			bool processed_work = false;
-
-			{
-				std::lock_guard<std::mutex> lock(q_mutexes[tid]);
-
-				if (!local_queues[tid].empty()) {
-					int v = local_queues[tid].front(); // should i make a copy here instead of double memory hit each time? -- maybe i can't write right if i do
-					local_queues[tid].pop();
-
-					processed_work = true;
-
-					vector<int> neighbors = wg.do_work(v);
-
-					// lock before adding neighbors to local q
-					std::lock_guard<std::mutex> lock_visited(visited_lock);
-					int new_work = 0;
-					for (int i : neighbors) {
-						// for each neighbor, check and mark visited, add to todos
-						if (visited.insert(i).second) { // evals to true if its a new addition
-
-							// std::lock_guard<std::mutex> curr_q_lock(q_mutexes[tid]);
-							local_queues[tid].push(i); // i do NOT like how many memory hits this is......
-							new_work++;
-						}
-					}
-
-					work_counter.fetch_add(new_work - 1, std::memory_order_relaxed);
-
-				}
-			}
-			
-			if (!processed_work) { // i.e. we have run out of work in local q -- steal from someone else
-
-				bool found_new_work = false;
-
-				for (int victimThread = 0; victimThread < _numThreads; victimThread++) {
-					if (victimThread == tid) continue;
-
-					std::unique_lock<std::mutex> victim_lock(
-						q_mutexes[victimThread], std::try_to_lock
-					);
-
-					if (victim_lock.owns_lock()) {
-						std::queue<int>& stealing_from_queue = local_queues[victimThread];
-						if (!stealing_from_queue.empty()) {
-							// now is when we steal HALF of another thread's work
-
-							int steal_size = stealing_from_queue.size() / 2;
-							std::lock_guard<std::mutex> own_q_lock(q_mutexes[tid]);
-
-							while (steal_size-- > 0 && !stealing_from_queue.empty()) {
-								int v = stealing_from_queue.front();
-								stealing_from_queue.pop();
-								local_queues[tid].push(v);
-							}
-
-							found_new_work = true;
-							break; // get to processing the work we just stole
-						}
-					}
-				}
-
-
-				// if we go thru all those guys and find nothing, we're done!
-				if (!found_new_work) {
-					if (work_counter.load() == 0) {
-						done = true;
-					}
-				}
-
-			}
-		}
-
-	}
-
-
-}
-
 
 //
 // main:
@@ -178,14 +62,32 @@ int main(int argc, char *argv[])
 	//
 	// Set defaults, process environment & cmd-line args:
 	//
+	Affinity::SetPolicy("compact");  // stealing is locality-first, see steal.cpp
+
 	ProcessCmdLineArgs(argc, argv);
 
 	WorkGraph wg;  // NOTE: wg MUST be created in sequential code
 
 	cout << "Graph size:   " << wg.num_vertices() << " vertices" << endl;
 	cout << "Start vertex: " << wg.start_vertex() << endl;
-	cout << "# of threads: " << _numThreads << endl;
+	//
+	// the pipeline may need more threads than asked for (see traversal.h),
+	// so report, bind and trace as many as will actually run:
+	//
+	int team = (_mode == "pipeline") ? pipelineThreads(_numThreads) : _numThreads;
+
+	cout << "# of threads: " << team;
+	if (team != _numThreads)
+		cout << " (-t " << _numThreads << ", but the pipeline needs a worker and a dedup shard)";
 	cout << endl;
+	cout << "Mode:         " << _mode << endl;
+	Affinity::Report(team);
+	cout << endl;
+
+	Affinity::BindOpenMP(team);
+
+	if (_traceFile != "")
+		Trace::Enable(team);
 
 	cout << "working";
 	cout.flush();
@@ -234,7 +136,16 @@ int main(int argc, char *argv[])
 	// cout << endl;
 
 	// PARALLEL
-	parallelWork(wg);
+	if (_mode == "frontier")
+		frontierWork(wg, _numThreads);
+	else if (_mode == "direction")
+		directionWork(wg, _numThreads);
+	else if (_mode == "priority")
+		priorityWork(wg, _numThreads);
+	else if (_mode == "pipeline")
+		pipelineWork(wg, _numThreads);
+	else
+		parallelWork(wg, _numThreads, _checkpointFile, _resume);
 
   
 
@@ -247,6 +158,9 @@ int main(int argc, char *argv[])
 
 	cout << endl;
 	cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
+
+	if (_traceFile != "")
+		Trace::Write(_traceFile);
 	cout << "** Execution complete **" << endl;
   cout << endl;
 
@@ -264,7 +178,7 @@ static void ProcessCmdLineArgs(int argc, char* argv[])
 
 		if (strcmp(argv[i], "-?") == 0)  // help:
 		{
-			cout << "**Usage: work [-?] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: work [-?] [-t NumThreads] [-mode steal|frontier|direction|priority|pipeline] [-bind compact|spread|cores|list:CPUS|none] [-trace file.json] [-checkpoint file] [-resume]" << endl << endl;
 			exit(0);
 		}
 		else if ((strcmp(argv[i], "-t") == 0) && (i+1 < argc))  // # of threads:
@@ -272,12 +186,65 @@ static void ProcessCmdLineArgs(int argc, char* argv[])
 			i++;
 			_numThreads = atoi(argv[i]);
 		}
+		else if ((strcmp(argv[i], "-mode") == 0) && (i+1 < argc))  // traversal engine:
+		{
+			i++;
+			_mode = argv[i];
+
+			if (_mode != "steal" && _mode != "frontier" && _mode != "direction" && _mode != "priority" && _mode != "pipeline")
+			{
+				cout << "**Unknown mode: '" << argv[i] << "'" << endl;
+				cout << "**Usage: work [-?] [-t NumThreads] [-mode steal|frontier|direction|priority|pipeline] [-bind compact|spread|cores|list:CPUS|none] [-trace file.json] [-checkpoint file] [-resume]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-bind") == 0) && (i+1 < argc))  // thread placement:
+		{
+			i++;
+
+			if (!Affinity::SetPolicy(argv[i]))
+			{
+				cout << "**Unknown bind policy: '" << argv[i] << "'" << endl;
+				cout << "**Usage: work [-?] [-t NumThreads] [-mode steal|frontier|direction|priority|pipeline] [-bind compact|spread|cores|list:CPUS|none] [-trace file.json] [-checkpoint file] [-resume]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-trace") == 0) && (i+1 < argc))  // timeline output:
+		{
+			i++;
+			_traceFile = argv[i];
+		}
+		else if ((strcmp(argv[i], "-checkpoint") == 0) && (i+1 < argc))  // checkpoint file:
+		{
+			i++;
+			_checkpointFile = argv[i];
+		}
+		else if (strcmp(argv[i], "-resume") == 0)  // resume from checkpoint:
+		{
+			_resume = true;
+		}
 		else  // error: unknown arg
 		{
 			cout << "**Unknown argument: '" << argv[i] << "'" << endl;
-			cout << "**Usage: work [-?] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: work [-?] [-t NumThreads] [-mode steal|frontier|direction|priority|pipeline] [-bind compact|spread|cores|list:CPUS|none] [-trace file.json] [-checkpoint file] [-resume]" << endl << endl;
 			exit(0);
 		}
 
 	}//for
+
+	if (_resume && _checkpointFile == "")
+		_checkpointFile = "work.ckpt";
+
+	if (_checkpointFile != "" && _mode != "steal")
+	{
+		cout << "**-checkpoint and -resume are only supported with -mode steal" << endl << endl;
+		exit(0);
+	}
+
+	if (_checkpointFile != "" && WorkInstance == nullptr)
+	{
+		cout << "**-checkpoint and -resume need a work graph that can be rebuilt exactly, i.e. the" << endl;
+		cout << "  synthetic one (make synthetic); workgraph.o draws a new graph every run" << endl << endl;
+		exit(0);
+	}
 }
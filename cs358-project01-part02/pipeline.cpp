@@ -0,0 +1,282 @@
+/*pipeline.cpp*/
+
+//
+// Pipelined traversal of a WorkGraph, with deduplication decoupled from
+// the workers, see traversal.h.
+//
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <unordered_set>
+#include <algorithm>
+#include <omp.h>
+
+#include "traversal.h"
+#include "ring.h"
+#include "arena.h"
+#include "trace.h"
+
+using namespace std;
+
+
+//
+// pipelineThreads:
+//
+// About 1 in 4 threads is a dedup shard, the rest are workers, with at
+// least 1 of each:
+//
+int pipelineThreads(int numThreads) {
+
+	int num_shards = max(1, numThreads / 4);
+	int num_workers = max(1, numThreads - num_shards);
+
+	return num_workers + num_shards;
+}
+
+
+//
+// pipelineWork:
+//
+// The threads are split into workers, which solve vertices, and dedup
+// shards, which decide which vertices are new: about 1 in 4 threads is a
+// shard (at least 1 of each; with -t 1 there's 1 worker and 1 shard, so
+// 2 threads, see pipelineThreads --- main reports and binds that many).
+//
+// Each shard owns a hash partition of the vertex ids, and is the only one
+// to see the ids in its partition, so its visited set is private: no locks,
+// no shared cache lines. After do_work, a worker sorts the neighbors by
+// shard and pushes each batch into the ring (see ring.h) between it and
+// that shard, one ring per (worker, shard) pair, so every ring has a single
+// producer and a single consumer. A shard drains its rings, drops the ids
+// it has seen before, and pushes the new ones onto the deque of the worker
+// that found them. So workers never touch visited state, and deduplication
+// scales with the # of shards.
+//
+// Workers take vertices from the front of their own deque, and when it's
+// empty steal half of another worker's, as in parallelWork. A worker whose
+// ring is full waits for the shard (counted as a stall).
+//
+// outstanding is the # of vertices queued or being solved plus the # of
+// ids in the rings; it's raised before anything is handed on and lowered
+// after, so it only reaches 0 when everything is done.
+//
+void pipelineWork(WorkGraph& wg, int numThreads) {
+
+	typedef deque<int, ArenaAllocator<int>> VertexDeque;
+
+	struct alignas(64) Worker {
+		mutex  lock;
+		Arena  arena;       // for queue, used under lock
+		VertexDeque queue;  // vertex ids to solve
+		long   solved = 0;
+		long   stalls = 0;  // pushes that found the ring full
+
+		Worker() : queue(ArenaAllocator<int>(&arena)) { }
+	};
+
+	struct alignas(64) Shard {
+		long ids = 0;       // ids received
+		long fresh = 0;     // ... of which were new
+	};
+
+	int num_shards = max(1, numThreads / 4);
+	int num_threads = pipelineThreads(numThreads);
+	int num_workers = num_threads - num_shards;
+
+	vector<Worker> workers(num_workers);
+	vector<Shard> shards(num_shards);
+	SpscRing* rings = new SpscRing[num_workers * num_shards];  // rings[w * num_shards + s]
+
+	atomic<bool> done(false);
+	atomic<long> outstanding(0);
+
+	auto shard_of = [num_shards](int id) {
+		unsigned h = (unsigned) id * 2654435761u;  // as in vertexids.h
+		return (int) ((h >> 16) % num_shards);
+	};
+
+	//
+	// the start vertex goes through its shard like any other, which hands
+	// it to worker 0:
+	//
+	int start_id = wg.start_vertex();
+	outstanding = 1;
+	rings[shard_of(start_id)].push(&start_id, 1);
+
+	#pragma omp parallel num_threads(num_threads)
+	{
+		int tid = omp_get_thread_num();
+
+		if (tid < num_workers) {
+			//
+			// worker:
+			//
+			Worker& me = workers[tid];
+			vector<vector<int>> batches(num_shards);  // neighbors, by shard
+			vector<int> stolen;
+			minstd_rand rng(tid + 1);
+
+			while (!done) {
+
+				int v = 0;
+				bool claimed = false;
+
+				{
+					lock_guard<mutex> lock(me.lock);
+
+					if (!me.queue.empty()) {
+						v = me.queue.front();
+						me.queue.pop_front();
+						claimed = true;
+					}
+				}
+
+				if (claimed) {
+					double trace_start = Trace::Now();
+					vector<int> neighbors = wg.do_work(v);
+					Trace::Record(tid, "do_work", trace_start, Trace::Now(), "vertex", v);
+
+					me.solved++;
+
+					for (int id : neighbors)
+						batches[shard_of(id)].push_back(id);
+
+					outstanding += (long) neighbors.size();
+
+					for (int s = 0; s < num_shards; s++) {
+						vector<int>& batch = batches[s];
+						SpscRing& ring = rings[tid * num_shards + s];
+						int sent = 0;
+
+						while (sent < (int) batch.size()) {
+							int n = ring.push(batch.data() + sent, (int) batch.size() - sent);
+							sent += n;
+
+							if (sent < (int) batch.size()) {
+								me.stalls++;
+								this_thread::yield();
+							}
+						}
+
+						batch.clear();
+					}
+
+					outstanding--;  // v is done, its neighbors are in the rings
+					continue;
+				}
+
+				//
+				// out of work: steal half of another worker's deque, starting
+				// at a random one:
+				//
+				int first = rng() % num_workers;
+
+				for (int k = 0; k < num_workers && stolen.empty(); k++) {
+					Worker& victim = workers[(first + k) % num_workers];
+					if (&victim == &me)
+						continue;
+
+					unique_lock<mutex> lock(victim.lock, try_to_lock);
+					if (!lock.owns_lock())
+						continue;
+
+					int n = ((int) victim.queue.size() + 1) / 2;
+					while (n-- > 0) {
+						stolen.push_back(victim.queue.back());
+						victim.queue.pop_back();
+					}
+				}
+
+				if (!stolen.empty()) {
+					lock_guard<mutex> lock(me.lock);
+					me.queue.insert(me.queue.end(), stolen.begin(), stolen.end());
+					stolen.clear();
+				}
+				else if (outstanding.load() == 0)
+					done = true;
+				else
+					this_thread::yield();
+			}
+		}
+		else {
+			//
+			// dedup shard: drain each worker's ring, route new ids back to
+			// that worker:
+			//
+			int s = tid - num_workers;
+			Shard& me = shards[s];
+			unordered_set<int> visited;
+			vector<int> batch(1024), fresh;
+
+			visited.reserve(2 * wg.num_vertices() / num_shards + 16);
+
+			while (!done) {
+				long got = 0;
+
+				for (int w = 0; w < num_workers; w++) {
+					int n = rings[w * num_shards + s].pop(batch.data(), (int) batch.size());
+					if (n == 0)
+						continue;
+
+					fresh.clear();
+					for (int i = 0; i < n; i++)
+						if (visited.insert(batch[i]).second)
+							fresh.push_back(batch[i]);
+
+					if (!fresh.empty()) {
+						outstanding += (long) fresh.size();
+
+						lock_guard<mutex> lock(workers[w].lock);
+						workers[w].queue.insert(workers[w].queue.end(), fresh.begin(), fresh.end());
+					}
+
+					outstanding -= n;  // the ids are out of the ring
+
+					me.ids += n;
+					me.fresh += (long) fresh.size();
+					got += n;
+				}
+
+				if (got > 0)
+					continue;
+
+				if (outstanding.load() == 0)
+					done = true;
+				else
+					this_thread::yield();
+			}
+		}
+	}
+
+	delete[] rings;
+
+	//
+	// statistics:
+	//
+	long solved = 0, stalls = 0, ids = 0, fresh = 0, busiest = 0;
+
+	for (Worker& w : workers) {
+		solved += w.solved;
+		stalls += w.stalls;
+	}
+
+	for (Shard& s : shards) {
+		ids += s.ids;
+		fresh += s.fresh;
+		busiest = max(busiest, s.ids);
+	}
+
+	cout << endl;
+	cout << "Vertices solved: " << solved << endl;
+	cout << "Pipeline:        " << num_workers << " worker(s), " << num_shards << " dedup shard(s)" << endl;
+	cout << "Dedup:           " << ids << " ids in, " << fresh << " new, "
+	     << ids - fresh << " duplicates dropped; busiest shard took "
+	     << (ids > 0 ? 100 * busiest / ids : 0) << "% of the ids" << endl;
+	cout << "Ring stalls:     " << stalls << " (a worker waited for a full ring)" << endl;
+}
@@ -0,0 +1,244 @@
+/*priority.cpp*/
+
+//
+// Priority-scheduled traversal of a WorkGraph, see traversal.h.
+//
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <omp.h>
+
+#include "traversal.h"
+#include "vertexids.h"
+#include "trace.h"
+
+using namespace std;
+
+
+//
+// priorityWork:
+//
+// Instead of a FIFO queue per thread, vertices go into a MultiQueue: 2 heaps
+// per thread, each with its own lock. A push goes to a random heap; a pop
+// peeks at the tops of 2 random heaps and pops from the better one. There's
+// no global heap to fight over, and the pops are close enough to the true
+// order for scheduling.
+//
+// The priority depends on the phase of the traversal:
+//
+//   discovery: while vertices are still being discovered, oldest-first
+//              (priority = -dense index), i.e. roughly breadth-first, which
+//              keeps the frontier growing.
+//
+//   endgame:   once all num_vertices() are discovered, what's queued is all
+//              the work that's left, and the wall clock is set by whichever
+//              thread finishes last. So we run longest-expected-first: each
+//              heap is re-keyed by expected cost the first time it is
+//              touched in the endgame.
+//
+// The expected cost of a vertex is a running model: half the cost of the
+// vertex that discovered it, half the mean cost so far. (do_work costs are
+// random, so the model can only be as good as the graph allows.)
+//
+// At the end we report the tail: the time from when the first thread runs
+// out of work for good to when the last one finishes. parallelWork reports
+// the same, for comparison.
+//
+void priorityWork(WorkGraph& wg, int numThreads) {
+
+	struct Item {
+		float key;
+		int   v;
+		bool operator<(const Item& other) const { return key < other.key; }
+	};
+
+	struct alignas(64) Heap {
+		mutex        lock;
+		vector<Item> items;  // a max-heap on key
+		int          phase;  // phase the keys were computed for
+	};
+
+	VertexIds ids(wg.num_vertices());
+	vector<float> cost(ids.capacity());      // actual do_work time, in secs
+	vector<float> expected(ids.capacity());  // predicted do_work time
+
+	int num_heaps = 2 * numThreads;
+	vector<Heap> heaps(num_heaps);
+
+	atomic<int> phase(0);  // 0 = discovery, 1 = endgame
+	atomic<bool> done(false);
+	atomic<int> work_counter(0);
+	atomic<long> total_usecs(0);
+	atomic<int> num_solved(0);
+
+	vector<chrono::high_resolution_clock::time_point> last_done(numThreads);  // epoch until a thread solves a vertex
+
+	auto key_of = [&](int v, int p) -> float {
+		return (p == 0) ? (float) -v : expected[v];
+	};
+
+	//
+	// re-key a heap if it's behind the current phase; call with its lock held:
+	//
+	auto rekey = [&](Heap& h) {
+		int p = phase.load();
+		if (h.phase == p)
+			return;
+
+		for (Item& item : h.items)
+			item.key = key_of(item.v, p);
+
+		make_heap(h.items.begin(), h.items.end());
+		h.phase = p;
+	};
+
+	for (Heap& h : heaps)
+		h.phase = 0;
+
+	bool fresh_v;
+	int start_v = ids.intern(wg.start_vertex(), fresh_v);
+
+	expected[start_v] = 0.0f;
+	heaps[0].items.push_back(Item{ key_of(start_v, 0), start_v });
+	work_counter++;
+
+	auto start = chrono::high_resolution_clock::now();
+
+	#pragma omp parallel num_threads(numThreads)
+	{
+		int tid = omp_get_thread_num();
+		minstd_rand rng(tid + 1);
+		uniform_int_distribution<int> pick(0, num_heaps - 1);
+
+		vector<int> fresh;  // newly discovered vertices
+
+
+		while (!done) {
+
+			//
+			// choose the better of 2 random heaps by peeking at their tops,
+			// then pop from it (it may have changed since, which is fine):
+			//
+			int a = pick(rng), b = pick(rng);
+			float best_key[2];
+			int choice[2] = { a, b };
+
+			for (int c = 0; c < 2; c++) {
+				Heap& h = heaps[choice[c]];
+				lock_guard<mutex> lock(h.lock);
+
+				rekey(h);
+				best_key[c] = h.items.empty() ? -1e30f : h.items.front().key;
+			}
+
+			int v = -1;
+			int first = (best_key[0] >= best_key[1]) ? a : b;
+
+			//
+			// pop from the chosen heap; if it's empty, sweep all the heaps
+			// once before concluding there's nothing to do:
+			//
+			for (int k = 0; k < num_heaps && v < 0; k++) {
+				Heap& h = heaps[(first + k) % num_heaps];
+				lock_guard<mutex> lock(h.lock);
+
+				rekey(h);
+				if (!h.items.empty()) {
+					pop_heap(h.items.begin(), h.items.end());
+					v = h.items.back().v;
+					h.items.pop_back();
+				}
+			}
+
+			if (v < 0) {
+				if (work_counter.load() == 0)
+					done = true;
+				continue;
+			}
+
+			//
+			// solve v, with no locks held:
+			//
+			auto work_start = chrono::high_resolution_clock::now();
+
+			double trace_start = Trace::Now();
+
+			vector<int> neighbors = wg.do_work(ids.id_of(v));
+			Trace::Record(tid, "do_work", trace_start, Trace::Now(), "vertex", ids.id_of(v));
+
+			auto work_stop = chrono::high_resolution_clock::now();
+			last_done[tid] = work_stop;
+
+			cost[v] = chrono::duration<float>(work_stop - work_start).count();
+			total_usecs += (long) (cost[v] * 1e6f);
+			int solved = ++num_solved;
+
+			float mean = (total_usecs.load() / 1e6f) / solved;
+
+			fresh.clear();
+			for (int n : neighbors) {
+				bool is_new;
+				int index = ids.intern(n, is_new);
+
+				if (is_new) {  // true => we discovered it
+					expected[index] = 0.5f * cost[v] + 0.5f * mean;
+					fresh.push_back(index);
+				}
+			}
+
+			if (ids.size() == ids.capacity())  // everything's been discovered
+				phase = 1;
+
+			//
+			// publish the new vertices, each to a random heap:
+			//
+			work_counter.fetch_add((int) fresh.size());
+
+			for (int n : fresh) {
+				Heap& h = heaps[pick(rng)];
+				lock_guard<mutex> lock(h.lock);
+
+				rekey(h);
+				h.items.push_back(Item{ key_of(n, h.phase), n });
+				push_heap(h.items.begin(), h.items.end());
+			}
+
+			work_counter--;  // v is finished
+		}
+	}
+
+	//
+	// tail: first thread idle for good -> last thread done, over the threads
+	// that solved something; one that never did has no "last done", and
+	// counting it from the start would make the tail the whole run:
+	//
+	auto first_idle = chrono::high_resolution_clock::time_point::max();
+	auto last_busy = start;
+	int never = 0;
+
+	for (auto t : last_done) {
+		if (t == chrono::high_resolution_clock::time_point()) {  // never solved a vertex
+			never++;
+			continue;
+		}
+
+		first_idle = min(first_idle, t);
+		last_busy = max(last_busy, t);
+	}
+
+	if (never == numThreads)
+		first_idle = last_busy;
+
+	cout << endl;
+	cout << "Vertices solved: " << num_solved << endl;
+	cout << "Tail: " << chrono::duration<double>(last_busy - first_idle).count()
+	     << " secs (first thread idle for good -> last thread done)";
+	if (never > 0)
+		cout << ", " << never << " thread(s) never solved a vertex";
+	cout << endl;
+}
@@ -0,0 +1,86 @@
+/*ring.h*/
+
+//
+// SpscRing: a bounded, lock-free ring buffer of ints with exactly one
+// producer thread and one consumer thread. The producer only writes tail,
+// the consumer only writes head, each on its own cache line, so the two
+// sides never write the same line except for the slots themselves.
+// Both sides work in batches: a push or pop moves as many ints as fit in
+// one go, with one atomic store.
+//
+// The producer also caches the last head it saw (and the consumer the last
+// tail), so it only reads the other side's index when the ring looks full
+// (or empty).
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <algorithm>
+
+class SpscRing {
+    public:
+
+      // capacity must be a power of 2:
+      SpscRing(int capacity = 1024)
+        : slots(new int[capacity]), mask(capacity - 1),
+          head(0), tail(0), cached_head(0), cached_tail(0)
+      { }
+
+      ~SpscRing()
+      {
+        delete[] slots;
+      }
+
+      SpscRing(const SpscRing&) = delete;
+      SpscRing& operator=(const SpscRing&) = delete;
+
+      //
+      // push: (producer) appends up to n ints from in, returns how many fit:
+      //
+      int push(const int* in, int n)
+      {
+        size_t t = tail.load(std::memory_order_relaxed);
+
+        if (t + n - cached_head > mask + 1)
+          cached_head = head.load(std::memory_order_acquire);
+
+        int room = (int) std::min<size_t>(n, mask + 1 - (t - cached_head));
+
+        for (int i = 0; i < room; i++)
+          slots[(t + i) & mask] = in[i];
+
+        tail.store(t + room, std::memory_order_release);
+        return room;
+      }
+
+      //
+      // pop: (consumer) removes up to max ints into out, returns how many:
+      //
+      int pop(int* out, int max)
+      {
+        size_t h = head.load(std::memory_order_relaxed);
+
+        if (h == cached_tail)
+          cached_tail = tail.load(std::memory_order_acquire);
+
+        int n = (int) std::min<size_t>(max, cached_tail - h);
+
+        for (int i = 0; i < n; i++)
+          out[i] = slots[(h + i) & mask];
+
+        head.store(h + n, std::memory_order_release);
+        return n;
+      }
+
+    private:
+
+      int*    slots;
+      size_t  mask;
+
+      alignas(64) std::atomic<size_t> head;  // next slot to pop
+      alignas(64) std::atomic<size_t> tail;  // next slot to push
+      alignas(64) size_t cached_head;        // producer's copy of head
+      alignas(64) size_t cached_tail;        // consumer's copy of tail
+};
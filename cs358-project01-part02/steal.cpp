@@ -0,0 +1,475 @@
+/*steal.cpp*/
+
+//
+// Work-stealing traversal of a WorkGraph, see traversal.h.
+//
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <omp.h>
+
+#include "traversal.h"
+#include "vertexids.h"
+#include "arena.h"
+#include "affinity.h"
+#include "trace.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+
+//
+// parallelWork:
+//
+// Work-stealing traversal: each thread has its own queue of vertices to
+// solve, and steals half of another thread's queue when its own runs dry.
+//
+// Locks are only held to move vertices in and out of queues, never around
+// do_work, so a thread's queue can be stolen from while it is busy solving
+// a long vertex. Locks are also never nested: a vertex is claimed under the
+// queue lock, do_work runs with no locks held, the neighbors are interned
+// (which tells us which ones are new, see vertexids.h), and the new ones are
+// pushed in one batch under the queue lock. Likewise a thief copies stolen
+// vertices out under the victim's lock, then pushes them under its own.
+//
+// Stealing is locality-first (see topology.h): given where each thread is
+// bound (see affinity.h), a thief tries the threads in its own core complex,
+// then those on its own node, then remote ones --- in random order within
+// each group, so idle threads don't all pile onto the same victim. A thief
+// takes half of a nearby queue, but 3/4 of a remote one, since a
+// cross-node steal costs more and should be done less often. Steals are
+// counted by distance and reported at the end.
+//
+// With tracing on (see trace.h), each thread records its do_work calls, its
+// successful steals, and its idle periods; the failed steal rounds of an
+// idle period are counted in the idle event rather than recorded one by
+// one, since an idle thread retries continuously.
+//
+// Queues hold dense vertex indices rather than vertex ids, and per-vertex
+// statistics (solved flag, do_work time) live in flat arrays indexed by
+// them; a summary is printed at the end, along with the tail (see
+// priorityWork).
+//
+// With a checkpoint file, the solved and pending (discovered but not yet
+// solved) vertices are saved every few seconds by a background thread, see
+// Snapshot; with resume, the run starts from that checkpoint instead of
+// the start vertex, see Resume.
+//
+// Each queue allocates from its own arena (see arena.h), only ever under
+// the queue's lock; likewise the interned ids, per shard (see vertexids.h).
+// So, after warming up, the traversal's own containers reuse their blocks
+// rather than going to the global heap, and the arenas are released in
+// bulk at the end; the allocations are reported then. (The vectors that
+// do_work returns are allocated by the WorkGraph, which we can't change.)
+//
+// work_counter is the # of vertices queued or being solved; when it hits 0,
+// with every queue empty, we're done.
+//
+typedef std::queue<int, std::deque<int, ArenaAllocator<int>>> VertexQueue;
+
+static std::string Snapshot(WorkGraph& wg, VertexIds& ids, AtomicBitmap& solved);
+static int Resume(const std::string& path, WorkGraph& wg, VertexIds& ids, AtomicBitmap& solved,
+                  std::vector<VertexQueue>& queues);
+
+void parallelWork(WorkGraph& wg, int numThreads, const std::string& checkpointFile, bool resume) {
+
+	VertexIds ids(wg.num_vertices());
+	AtomicBitmap solved(ids.capacity());
+	std::vector<float> cost(ids.capacity());  // do_work time of each vertex, in secs
+
+	Arena* arenas = new Arena[numThreads];  // one per queue, used under its lock
+
+	std::vector<VertexQueue> local_queues; // make one local q per rthread
+	std::vector<std::mutex> q_mutexes(numThreads);
+
+	for (int t = 0; t < numThreads; t++)
+		local_queues.emplace_back(std::deque<int, ArenaAllocator<int>>(ArenaAllocator<int>(&arenas[t])));
+
+	std::atomic<bool> done(false);
+	std::atomic<int> work_counter(0);
+	std::atomic<int> solved_twice(0);
+
+	std::vector<chrono::high_resolution_clock::time_point> last_done(numThreads);  // epoch until a thread solves a vertex
+
+	//
+	// victims are grouped by their distance from the thief; if threads
+	// aren't bound, we don't know where they are, so they're all "near":
+	//
+	const Topology& topo = Affinity::Topo();
+	std::vector<std::vector<int>> victims[3];
+	std::atomic<long> steals[3];
+
+	for (int d = 0; d < 3; d++) {
+		victims[d].resize(numThreads);
+		steals[d] = 0;
+	}
+
+	for (int t = 0; t < numThreads; t++)
+		for (int v = 0; v < numThreads; v++)
+			if (v != t) {
+				int d = Topology::SAME_COMPLEX;
+				if (Affinity::Position(0) >= 0)
+					d = topo.distance(Affinity::Position(t), Affinity::Position(v));
+
+				victims[d][t].push_back(v);
+			}
+
+	auto start = chrono::high_resolution_clock::now();
+
+	int pending = 0;
+	if (resume)
+		pending = Resume(checkpointFile, wg, ids, solved, local_queues);
+
+	if (pending > 0)
+		work_counter += pending;
+	else if (ids.size() == 0) {  // nothing to resume, start from scratch
+		bool fresh_v;
+		int start_v = ids.intern(wg.start_vertex(), fresh_v);
+
+		local_queues[0].push(start_v);
+		work_counter++;
+	}
+
+	Checkpointer* checkpointer = nullptr;
+	if (checkpointFile != "")
+		checkpointer = new Checkpointer(checkpointFile, 5.0,
+			[&]() { return Snapshot(wg, ids, solved); });
+
+	#pragma omp parallel num_threads(numThreads)
+	{
+		int tid = omp_get_thread_num();
+
+		std::vector<int> fresh;   // newly discovered vertices, published in one batch
+		std::vector<int> stolen;  // vertices taken from a victim, ditto
+
+
+		std::minstd_rand rng(tid + 1);
+
+		bool   idle = false;        // for tracing: are we in an idle period,
+		double idle_start = 0.0;    // since when,
+		long   failed_steals = 0;   // and how many steal rounds have failed?
+
+		while (!done) {
+
+			//
+			// claim a vertex from our own queue, holding the lock just long
+			// enough to pop it:
+			//
+			int v = 0;
+			bool claimed = false;
+
+			{
+				std::lock_guard<std::mutex> lock(q_mutexes[tid]);
+
+				if (!local_queues[tid].empty()) {
+					v = local_queues[tid].front();
+					local_queues[tid].pop();
+					claimed = true;
+				}
+			}
+
+			if (claimed) {
+				//
+				// no locks held here, so others can steal from our queue:
+				//
+				auto work_start = chrono::high_resolution_clock::now();
+				double trace_start = Trace::Now();
+
+				vector<int> neighbors = wg.do_work(ids.id_of(v));
+
+				Trace::Record(tid, "do_work", trace_start, Trace::Now(), "vertex", ids.id_of(v));
+				auto work_stop = chrono::high_resolution_clock::now();
+				last_done[tid] = work_stop;
+				cost[v] = chrono::duration<float>(work_stop - work_start).count();
+
+				fresh.clear();
+				for (int i : neighbors) {
+					bool is_new;
+					int index = ids.intern(i, is_new);
+
+					if (is_new)  // true => we discovered it
+						fresh.push_back(index);
+				}
+
+				//
+				// only now is v solved: its neighbors are interned, so a
+				// checkpoint that sees v solved also sees them:
+				//
+				if (solved.test_and_set(v))
+					solved_twice++;
+
+				if (!fresh.empty()) {
+					std::lock_guard<std::mutex> lock(q_mutexes[tid]);
+
+					for (int i : fresh)
+						local_queues[tid].push(i);
+				}
+
+				//
+				// v is finished, but its new neighbors are now queued:
+				//
+				work_counter.fetch_add((int) fresh.size() - 1);
+				continue;
+			}
+
+			//
+			// we have run out of work in local q -- steal from someone else,
+			// nearest first, starting at a random victim within each group.
+			// Take half, or 3/4 if remote (rounding up, so a lone vertex can
+			// be stolen too):
+			//
+			bool found_new_work = false;
+			double round_start = Trace::Now();
+
+			for (int d = 0; d < 3 && !found_new_work; d++) {
+				std::vector<int>& group = victims[d][tid];
+				int first = group.empty() ? 0 : rng() % group.size();
+
+				for (size_t k = 0; k < group.size(); k++) {
+					int victimThread = group[(first + k) % group.size()];
+
+					stolen.clear();
+					{
+						std::unique_lock<std::mutex> victim_lock(
+							q_mutexes[victimThread], std::try_to_lock
+						);
+
+						if (!victim_lock.owns_lock())
+							continue;
+
+						VertexQueue& stealing_from_queue = local_queues[victimThread];
+						int n = stealing_from_queue.size();
+						int steal_size = (d == Topology::REMOTE) ? (3 * n + 3) / 4 : (n + 1) / 2;
+
+						while (steal_size-- > 0) {
+							stolen.push_back(stealing_from_queue.front());
+							stealing_from_queue.pop();
+						}
+					}
+
+					if (!stolen.empty()) {
+						std::lock_guard<std::mutex> own_q_lock(q_mutexes[tid]);
+
+						for (int i : stolen)
+							local_queues[tid].push(i);
+
+						if (idle) {
+							Trace::Record(tid, "idle", idle_start, round_start, "failed_steals", failed_steals);
+							idle = false;
+						}
+						Trace::Record(tid, "steal", round_start, Trace::Now(),
+							"victim", victimThread, "vertices", (long) stolen.size());
+
+						steals[d]++;
+						found_new_work = true;
+						break; // get to processing the work we just stole
+					}
+				}
+			}
+
+			// if we go thru all those guys and find nothing, and nothing is
+			// queued or in progress anywhere, we're done!
+			if (!found_new_work) {
+				if (!idle) {
+					idle = true;
+					idle_start = round_start;
+					failed_steals = 0;
+				}
+				failed_steals++;
+
+				if (work_counter.load() == 0) {
+					done = true;
+				}
+			}
+		}
+
+		if (idle)
+			Trace::Record(tid, "idle", idle_start, Trace::Now(), "failed_steals", failed_steals);
+
+	}
+
+	//
+	// every vertex is solved, so the checkpoint is no longer needed:
+	//
+	if (checkpointer != nullptr) {
+		cout << endl << "Checkpoints written: " << checkpointer->count();
+		delete checkpointer;
+		Checkpointer::Remove(checkpointFile);
+	}
+
+	//
+	// per-vertex statistics:
+	//
+	int n = ids.size();
+	double total = 0.0, most = 0.0;
+
+	for (int v = 0; v < n; v++) {
+		total += cost[v];
+		if (cost[v] > most)
+			most = cost[v];
+	}
+
+	cout << endl;
+	cout << "Vertices solved: " << n;
+	if (n > 0)
+		cout << ", do_work mean " << total / n << " secs, max " << most << " secs";
+	cout << endl;
+
+	//
+	// tail: first thread idle for good -> last thread done, over the threads
+	// that solved something; one that never did has no "last done", and
+	// counting it from the start would make the tail the whole run:
+	//
+	auto first_idle = chrono::high_resolution_clock::time_point::max();
+	auto last_busy = start;
+	int never = 0;
+
+	for (auto t : last_done) {
+		if (t == chrono::high_resolution_clock::time_point()) {  // never solved a vertex
+			never++;
+			continue;
+		}
+
+		first_idle = min(first_idle, t);
+		last_busy = max(last_busy, t);
+	}
+
+	if (never == numThreads)
+		first_idle = last_busy;
+
+	cout << "Tail: " << chrono::duration<double>(last_busy - first_idle).count()
+	     << " secs (first thread idle for good -> last thread done)";
+	if (never > 0)
+		cout << ", " << never << " thread(s) never solved a vertex";
+	cout << endl;
+
+	cout << "Steals:          " << steals[Topology::SAME_COMPLEX] << " same complex, "
+	     << steals[Topology::SAME_NODE] << " same node, "
+	     << steals[Topology::REMOTE] << " cross-node ("
+	     << topo.num_nodes() << " node(s), " << topo.num_cpus() << " cpu(s))" << endl;
+
+	//
+	// allocations by the queues and the id map; with the queues gone, the
+	// queue arenas are released in bulk:
+	//
+	ArenaStats queue_stats, id_stats = ids.arena_stats();
+
+	local_queues.clear();
+	for (int t = 0; t < numThreads; t++)
+		queue_stats += arenas[t].stats();
+	delete[] arenas;
+
+	for (const ArenaStats* a : { &queue_stats, &id_stats }) {
+		cout << ((a == &queue_stats) ? "Allocs (queues): " : "Allocs (ids):    ")
+		     << a->allocations << " (" << a->bytes << " bytes, "
+		     << (a->allocations > 0 ? 100 * a->reused / a->allocations : 0) << "% reused), "
+		     << a->heap_calls << " from the heap (" << a->heap_bytes << " bytes)" << endl;
+	}
+
+	if (solved_twice > 0)
+		cout << "**ERROR: " << solved_twice << " vertices solved more than once" << endl;
+}
+
+
+//
+// Snapshot:
+//
+// The checkpoint: "WGCK", the graph's name (see WorkInstance in
+// checkpoint.h), size and start vertex (to recognize the graph on resume),
+// then the ids of the solved vertices, then those of
+// the pending ones. Runs on the checkpoint thread while the workers carry
+// on: the solved bits are read before the interned vertices, and a vertex
+// is marked solved only after its neighbors are interned, so every
+// neighbor of a solved vertex is in the checkpoint. A vertex solved in
+// between is saved as pending, and just redone after a resume.
+//
+static std::string Snapshot(WorkGraph& wg, VertexIds& ids, AtomicBitmap& solved) {
+
+	std::vector<char> is_solved(ids.capacity());
+	for (int i = 0; i < ids.capacity(); i++)
+		is_solved[i] = solved.test(i);
+
+	std::vector<std::pair<int, int>> interned;  // (vertex id, index)
+	ids.snapshot(interned);
+
+	std::vector<int> done, pending;
+	for (auto& p : interned)
+		(is_solved[p.second] ? done : pending).push_back(p.first);
+
+	std::string bytes = "WGCK";
+	Checkpointer::Put(bytes, std::string(WorkInstance()));
+	Checkpointer::Put(bytes, wg.num_vertices());
+	Checkpointer::Put(bytes, wg.start_vertex());
+
+	Checkpointer::Put(bytes, (int) done.size());
+	for (int id : done)
+		Checkpointer::Put(bytes, id);
+
+	Checkpointer::Put(bytes, (int) pending.size());
+	for (int id : pending)
+		Checkpointer::Put(bytes, id);
+
+	return bytes;
+}
+
+
+//
+// Resume:
+//
+// Loads the checkpoint at path: solved vertices are interned, marked
+// solved and credited to the graph (see WorkCredit in checkpoint.h),
+// pending ones are interned and dealt round-robin to the queues.
+// Returns the # of pending vertices; if there's no usable checkpoint,
+// nothing is loaded.
+//
+static int Resume(const std::string& path, WorkGraph& wg, VertexIds& ids, AtomicBitmap& solved,
+                  std::vector<VertexQueue>& queues) {
+
+	std::string bytes, instance;
+	size_t pos = 4;
+	int num_vertices = 0, start_vertex = 0, count = 0;
+
+	if (!Checkpointer::Load(path, bytes)) {
+		cout << endl << "Resume:          no checkpoint '" << path << "', starting from scratch" << endl;
+		return 0;
+	}
+
+	if (bytes.compare(0, 4, "WGCK") != 0 ||
+	    !Checkpointer::Get(bytes, pos, instance) || instance != WorkInstance() ||
+	    !Checkpointer::Get(bytes, pos, num_vertices) || !Checkpointer::Get(bytes, pos, start_vertex) ||
+	    num_vertices != wg.num_vertices() || start_vertex != wg.start_vertex()) {
+		cout << endl << "Resume:          checkpoint '" << path << "' is not for this graph, starting from scratch" << endl;
+		return 0;
+	}
+
+	std::vector<int> done, pending;
+
+	for (std::vector<int>* list : { &done, &pending }) {
+		if (!Checkpointer::Get(bytes, pos, count))
+			count = 0;
+
+		for (int i = 0, id; i < count && Checkpointer::Get(bytes, pos, id); i++)
+			list->push_back(id);
+	}
+
+	bool fresh;
+	for (int id : done) {
+		solved.test_and_set(ids.intern(id, fresh));
+		WorkCredit(id);
+	}
+
+	for (size_t i = 0; i < pending.size(); i++)
+		queues[i % queues.size()].push(ids.intern(pending[i], fresh));
+
+	cout << endl << "Resume:          " << done.size() << " vertices already solved, "
+	     << pending.size() << " pending" << endl;
+
+	return (int) pending.size();
+}
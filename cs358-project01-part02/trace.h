@@ -0,0 +1,200 @@
+/*trace.h*/
+
+//
+// Timeline tracing, written out as Chrome trace JSON (load the file in
+// chrome://tracing or ui.perfetto.dev).
+//
+// Each thread records into its own fixed-size ring buffer, so recording
+// takes no locks and no atomics: a clock read and a store. When a buffer
+// fills up, the oldest events are overwritten (and counted as dropped).
+// Buffers are only read by Write, once the threads are done.
+//
+// Usage:
+//
+//   Trace::Enable(numThreads);          // tracing is off unless enabled
+//   ...
+//   double start = Trace::Now();
+//   ... work ...
+//   Trace::Record(tid, "do_work", start, Trace::Now(), "vertex", v);
+//   ...
+//   Trace::Write("trace.json");
+//
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+class Trace {
+    public:
+
+      //
+      // Enable: turns tracing on for threads 0..numThreads-1, with room for
+      // capacity events per thread:
+      //
+      static void Enable(int numThreads, int capacity = 65536)
+      {
+        State& s = state();
+
+        s.threads = std::vector<Buffer>(numThreads);
+        for (Buffer& b : s.threads)
+          b.events.resize(capacity);
+
+        s.origin = std::chrono::steady_clock::now();
+        s.enabled = true;
+      }
+
+      static bool Enabled() { return state().enabled; }
+
+      // microseconds since Enable:
+      static double Now()
+      {
+        auto now = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(now - state().origin).count();
+      }
+
+      //
+      // Record: an event named name on thread tid, from start to end (both
+      // from Now()), with up to 2 integer arguments. name and the argument
+      // names must be string literals (only the pointers are kept):
+      //
+      static void Record(int tid, const char* name, double start, double end,
+                         const char* arg1 = nullptr, long value1 = 0,
+                         const char* arg2 = nullptr, long value2 = 0)
+      {
+        State& s = state();
+        if (!s.enabled)
+          return;
+
+        Buffer& b = s.threads[tid];
+        Event& e = b.events[b.next % b.events.size()];
+
+        e = Event{ name, start, end - start, arg1, value1, arg2, value2 };
+        b.next++;
+      }
+
+      //
+      // IdleUntil: for each thread, records an "idle" event from the end of
+      // its last event to end, e.g. time spent waiting at a barrier:
+      //
+      static void IdleUntil(double end)
+      {
+        State& s = state();
+        if (!s.enabled)
+          return;
+
+        for (size_t t = 0; t < s.threads.size(); t++)
+        {
+          Buffer& b = s.threads[t];
+          double last = 0.0;
+
+          if (b.next > 0)
+          {
+            Event& e = b.events[(b.next - 1) % b.events.size()];
+            last = e.ts + e.dur;
+          }
+
+          if (last < end)
+            Record((int) t, "idle", last, end);
+        }
+      }
+
+      //
+      // Write: writes every thread's events to path as Chrome trace JSON,
+      // and reports how many were written (and dropped):
+      //
+      static void Write(const std::string& path)
+      {
+        State& s = state();
+        if (!s.enabled)
+          return;
+
+        std::ofstream out(path);
+        if (!out.good())
+        {
+          std::cout << "**ERROR: unable to open trace file '" << path << "'" << std::endl;
+          return;
+        }
+
+        long written = 0, dropped = 0;
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+
+        for (size_t t = 0; t < s.threads.size(); t++)
+        {
+          Buffer& b = s.threads[t];
+
+          out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << t
+              << ",\"args\":{\"name\":\"thread " << t << "\"}}";
+
+          long size = (long) b.events.size();
+          long first = (b.next > size) ? b.next - size : 0;
+          dropped += first;
+
+          for (long i = first; i < b.next; i++)
+          {
+            const Event& e = b.events[i % size];
+
+            out << "," << std::endl
+                << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << t
+                << ",\"ts\":" << e.ts << ",\"dur\":" << e.dur;
+
+            if (e.arg1 != nullptr)
+            {
+              out << ",\"args\":{\"" << e.arg1 << "\":" << e.value1;
+              if (e.arg2 != nullptr)
+                out << ",\"" << e.arg2 << "\":" << e.value2;
+              out << "}";
+            }
+
+            out << "}";
+            written++;
+          }
+
+          out << (t + 1 < s.threads.size() ? "," : "") << std::endl;
+        }
+
+        out << "]}" << std::endl;
+
+        std::cout << "Trace: " << written << " events written to '" << path << "'";
+        if (dropped > 0)
+          std::cout << " (" << dropped << " oldest dropped, buffers were full)";
+        std::cout << std::endl;
+      }
+
+    private:
+
+      struct Event {
+        const char* name;
+        double      ts;   // usecs
+        double      dur;
+        const char* arg1;
+        long        value1;
+        const char* arg2;
+        long        value2;
+      };
+
+      //
+      // aligned so threads recording into neighboring buffers don't share
+      // a cache line:
+      //
+      struct alignas(64) Buffer {
+        std::vector<Event> events;
+        long               next = 0;  // total # recorded; next slot is next % size
+      };
+
+      struct State {
+        bool                                  enabled = false;
+        std::vector<Buffer>                   threads;
+        std::chrono::steady_clock::time_point origin;
+      };
+
+      static State& state()
+      {
+        static State s;
+        return s;
+      }
+};
@@ -0,0 +1,51 @@
+/*traversal.h*/
+
+//
+// Parallel traversals of a WorkGraph: each solves every vertex reachable
+// from the start vertex exactly once, using numThreads threads. Selected
+// in main.cpp with -mode.
+//
+
+#pragma once
+
+#include <string>
+
+#include "workgraph.h"
+
+//
+// work stealing: per-thread queues, idle threads steal; optionally
+// checkpoints to checkpointFile, and resumes from it (steal.cpp):
+//
+void parallelWork(WorkGraph& wg, int numThreads, const std::string& checkpointFile = "", bool resume = false);
+
+//
+// level-synchronous BFS: the whole frontier is solved in parallel, then
+// the next frontier, and so on; prints per-level statistics (frontier.cpp):
+//
+void frontierWork(WorkGraph& wg, int numThreads);
+
+//
+// level-synchronous BFS that switches between top-down and (an adaptation
+// of) bottom-up levels to cut visited-set traffic (direction.cpp):
+//
+void directionWork(WorkGraph& wg, int numThreads);
+
+//
+// MultiQueue scheduling: relaxed per-thread priority queues, oldest-first
+// while vertices are being discovered, then longest-expected-first to
+// shorten the tail (priority.cpp):
+//
+void priorityWork(WorkGraph& wg, int numThreads);
+
+//
+// pipelined: workers solve vertices and hand the neighbors, through ring
+// buffers, to dedup shards that each own a partition of the vertex ids
+// and send the new ones back (pipeline.cpp):
+//
+void pipelineWork(WorkGraph& wg, int numThreads);
+
+//
+// the # of threads pipelineWork actually runs for -t numThreads: it needs
+// at least one worker and one dedup shard, so -t 1 runs 2 threads:
+//
+int pipelineThreads(int numThreads);
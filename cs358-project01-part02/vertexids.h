@@ -0,0 +1,186 @@
+/*vertexids.h*/
+
+//
+// Dense vertex ids for a WorkGraph.
+//
+// WorkGraph vertices are identified by random integers, so anything kept
+// per vertex needs a hash lookup. VertexIds interns each vertex id the first
+// time it's seen, handing out dense indices 0, 1, 2, ... in order of
+// discovery. Interning is the one hash lookup per edge we can't avoid ---
+// it's also how duplicates are detected --- but from then on a vertex is
+// its index, and per-vertex data (flags, costs, adjacency) lives in flat
+// arrays sized from num_vertices(), e.g. an AtomicBitmap.
+//
+// The id -> index map is split across shards by hash, each with its own
+// lock, so threads interning different vertices rarely contend. Each shard
+// also has its own arena (see arena.h) for the map's nodes, used under the
+// shard's lock, so interning doesn't go to the global heap either.
+//
+
+#pragma once
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+#include <functional>
+
+#include "arena.h"
+
+class VertexIds {
+    public:
+
+      VertexIds(int capacity, int numShards = 256)
+        : shards(new Shard[numShards]), num_shards(numShards),
+          ids(new int[capacity]), cap(capacity), next(0)
+      { }
+
+      ~VertexIds()
+      {
+        delete[] shards;
+        delete[] ids;
+      }
+
+      //
+      // intern: returns the index of vertex id, assigning the next free index
+      // if id has not been seen before, in which case fresh is set to true
+      // (i.e. the caller is the one that discovered the vertex):
+      //
+      int intern(int id, bool &fresh)
+      {
+        Shard& s = shard(id);
+        std::lock_guard<std::mutex> lock(s.lock);
+
+        auto it = s.map.find(id);
+        if (it != s.map.end())
+        {
+          fresh = false;
+          return it->second;
+        }
+
+        int index = next.fetch_add(1);
+        if (index >= cap)
+        {
+          std::cout << "**ERROR: graph has more than num_vertices() = " << cap << " vertices" << std::endl;
+          exit(0);
+        }
+
+        ids[index] = id;
+        s.map.emplace(id, index);
+
+        fresh = true;
+        return index;
+      }
+
+      //
+      // snapshot: appends every (vertex id, index) pair interned so far to
+      // out; locks one shard at a time, so interning elsewhere carries on:
+      //
+      void snapshot(std::vector<std::pair<int, int>>& out)
+      {
+        for (int i = 0; i < num_shards; i++)
+        {
+          std::lock_guard<std::mutex> lock(shards[i].lock);
+          out.insert(out.end(), shards[i].map.begin(), shards[i].map.end());
+        }
+      }
+
+      //
+      // arena_stats: allocation counts of the shards' maps, see arena.h:
+      //
+      ArenaStats arena_stats()
+      {
+        ArenaStats total;
+
+        for (int i = 0; i < num_shards; i++)
+        {
+          std::lock_guard<std::mutex> lock(shards[i].lock);
+          total += shards[i].arena.stats();
+        }
+
+        return total;
+      }
+
+      // the vertex id of a given index:
+      int id_of(int index) const { return ids[index]; }
+
+      // # of vertices interned so far, and the most we can hold:
+      int size() const { return next.load(); }
+      int capacity() const { return cap; }
+
+    private:
+
+      //
+      // aligned so neighboring shards' locks are not on the same cache line:
+      //
+      typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                                 ArenaAllocator<std::pair<const int, int>>> Map;
+
+      struct alignas(64) Shard {
+        std::mutex lock;
+        Arena      arena;
+        Map        map;
+
+        // small slabs, since there are many shards:
+        Shard() : arena(4096),
+                  map(16, std::hash<int>(), std::equal_to<int>(), ArenaAllocator<std::pair<const int, int>>(&arena)) { }
+      };
+
+      Shard& shard(int id)
+      {
+        unsigned h = (unsigned) id * 2654435761u;  // ids are random, but mix anyway
+        return shards[(h >> 16) % num_shards];
+      }
+
+      Shard*           shards;
+      int              num_shards;
+      int*             ids;   // index -> vertex id
+      int              cap;
+      std::atomic<int> next;
+};
+
+
+//
+// AtomicBitmap: one bit per dense vertex index, set lock-free.
+//
+class AtomicBitmap {
+    public:
+
+      AtomicBitmap(int n)
+        : words(new std::atomic<uint64_t>[(n + 63) / 64]), num_words((n + 63) / 64)
+      {
+        clear();
+      }
+
+      ~AtomicBitmap()
+      {
+        delete[] words;
+      }
+
+      // test_and_set: sets bit i, returning its previous value:
+      bool test_and_set(int i)
+      {
+        uint64_t bit = 1ULL << (i % 64);
+        return (words[i / 64].fetch_or(bit) & bit) != 0;
+      }
+
+      bool test(int i) const
+      {
+        return (words[i / 64].load(std::memory_order_relaxed) >> (i % 64)) & 1;
+      }
+
+      void clear()
+      {
+        for (int w = 0; w < num_words; w++)
+          words[w].store(0, std::memory_order_relaxed);
+      }
+
+    private:
+
+      std::atomic<uint64_t>* words;
+      int                    num_words;
+};
@@ -0,0 +1,362 @@
+/*workgraph-synthetic.cpp*/
+
+//
+// Synthetic implementation of the WorkGraph class (workgraph.h), a drop-in
+// replacement for workgraph.o whose shape and costs come from a seed, so
+// runs can be repeated exactly. See synthetic.h for the cost options; also
+//
+//   WORK_VERTICES=n      # of vertices (default 10000)
+//   WORK_TOPOLOGY=kind   shape of the graph (default random):
+//                          random    a random tree from the start vertex,
+//                                    plus 3 random edges per vertex
+//                          powerlaw  preferential attachment: each new
+//                                    vertex hangs off an existing one chosen
+//                                    by degree, and links to 3 more chosen
+//                                    the same way, so a few hubs have most
+//                                    of the edges
+//                          grid      a square grid, edges both ways to the
+//                                    4 neighbors; the frontier grows slowly
+//                          chain     v0 -> v1 -> ... -> vn-1, no parallelism
+//                                    at all, the worst case
+//                          dense     a random tree plus 64 random edges per
+//                                    vertex
+//
+// Build with "make synthetic", which links against this file in place of
+// workgraph.o, e.g.
+//
+//   WORK_TOPOLOGY=powerlaw WORK_COST=bimodal ./work-synthetic -t 4
+//
+// As with workgraph.o, the graph is directed, has no multi-edges but may
+// have self-loops and cycles, every vertex is reachable from the start
+// vertex, and vertex ids are random integers. Every vertex must be solved
+// exactly once, which is checked when the last WorkGraph is destroyed;
+// vertices solved before a resume are credited with WorkCredit (see
+// checkpoint.h).
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "workgraph.h"
+#include "synthetic.h"
+
+using namespace std;
+
+
+//
+// State shared by all copies of the WorkGraph (copies share the one graph,
+// like workgraph.o); set up by the first constructor and checked by the
+// last destructor. Vertices are indexed 0..NumVertices-1 internally, index
+// 0 being the start vertex, with adjacency in CSR form:
+//
+static int                 refCount = 0;
+static int                 NumVertices = 0;
+static SyntheticOptions    Options;
+static vector<int>         Ids;        // index -> vertex id
+static unordered_map<int, int> Index;  // vertex id -> index
+static vector<long>        Offsets;    // NumVertices+1, into Targets
+static vector<int>         Targets;    // neighbor indices
+static vector<float>       Costs;      // per index, secs
+static atomic<int>*        Executed = nullptr;
+static atomic<bool>        Invalid(false);
+static atomic<double>      Sink(0.0);  // keeps the burned work alive
+static string              Instance;   // see WorkInstance
+
+static void BuildEdges(const string& topology, int n, mt19937_64& rng, vector<vector<int>>& adj);
+
+
+//
+// default constructor: must be called from sequential code.
+//
+WorkGraph::WorkGraph()
+{
+  if (refCount++ > 0)  // already set up:
+    return;
+
+  Options.Read();
+
+  NumVertices = 10000;
+  string topology = "random";
+
+  if (const char* s = getenv("WORK_VERTICES"))
+    NumVertices = atoi(s);
+  if (const char* s = getenv("WORK_TOPOLOGY"))
+    topology = s;
+
+  if (NumVertices < 1)
+  {
+    cout << "**Error: WORK_VERTICES must be > 0" << endl;
+    exit(0);
+  }
+
+  if (topology != "random" && topology != "powerlaw" && topology != "grid" &&
+      topology != "chain" && topology != "dense")
+  {
+    cout << "**Error: WORK_TOPOLOGY must be random, powerlaw, grid, chain or dense: '" << topology << "'" << endl;
+    exit(0);
+  }
+
+  mt19937_64 rng(Options.seed);
+  int n = NumVertices;
+
+  //
+  // edges, then each vertex's list sorted and de-duplicated (no
+  // multi-edges), flattened into CSR:
+  //
+  vector<vector<int>> adj(n);
+  BuildEdges(topology, n, rng, adj);
+
+  Offsets.assign(n + 1, 0);
+  Targets.clear();
+
+  for (int v = 0; v < n; v++)
+  {
+    sort(adj[v].begin(), adj[v].end());
+    adj[v].erase(unique(adj[v].begin(), adj[v].end()), adj[v].end());
+
+    //
+    // neighbors come back in random order, not sorted by index, which
+    // would make the traversal order too predictable:
+    //
+    shuffle(adj[v].begin(), adj[v].end(), rng);
+
+    Targets.insert(Targets.end(), adj[v].begin(), adj[v].end());
+    Offsets[v + 1] = (long) Targets.size();
+  }
+
+  //
+  // random, unique ids; positive, like workgraph.o's:
+  //
+  uniform_int_distribution<int> pick(1, max(10 * n, 100000));
+  unordered_set<int> used;
+
+  Ids.resize(n);
+  Index.clear();
+
+  for (int v = 0; v < n; v++)
+  {
+    int id;
+    do
+      id = pick(rng);
+    while (!used.insert(id).second);
+
+    Ids[v] = id;
+    Index[id] = v;
+  }
+
+  //
+  // costs; for "rows", blocks of 100 vertices close to each other in the
+  // graph (consecutive indices) share a scale:
+  //
+  Costs = SyntheticCosts(Options, n, 100, rng);
+
+  Executed = new atomic<int>[n];
+  for (int v = 0; v < n; v++)
+    Executed[v] = 0;
+
+  Invalid = false;
+
+  double total = 0.0;
+  for (float c : Costs)
+    total += c;
+
+  Instance = "graph " + to_string(n) + " vertices, " + topology + ", " + Options.Describe();
+
+  cout << "Synthetic:    " << n << " vertices, " << Targets.size() << " edges, " << topology
+       << ", " << Options.Describe() << " (" << total << " secs of work)" << endl;
+}
+
+
+//
+// copy constructor: shares the graph.
+//
+WorkGraph::WorkGraph(const WorkGraph& other)
+{
+  refCount++;
+}
+
+
+//
+// destructor: when the last copy goes, checks that every vertex was solved
+// exactly once.
+//
+WorkGraph::~WorkGraph()
+{
+  if (--refCount > 0)
+    return;
+
+  bool unsolved = false, multiple = false;
+
+  for (int v = 0; v < NumVertices; v++)
+  {
+    if (Executed[v] == 0)
+      unsolved = true;
+    else if (Executed[v] > 1)
+      multiple = true;
+  }
+
+  if (unsolved)
+    cout << "** WorkGraph results: at least one vertex was not solved" << endl;
+  if (multiple)
+    cout << "** WorkGraph results: at least one vertex was solved multiple times" << endl;
+  if (Invalid)
+    cout << "** WorkGraph results: at least one invalid vertex was passed to neighbors() or do_work()" << endl;
+  if (!unsolved && !multiple && !Invalid)
+    cout << "** WorkGraph results: all vertices properly solved!" << endl;
+
+  delete[] Executed;
+  Executed = nullptr;
+  Ids.clear();
+  Index.clear();
+  Offsets.clear();
+  Targets.clear();
+  Costs.clear();
+}
+
+
+int WorkGraph::num_vertices()
+{
+  return NumVertices;
+}
+
+int WorkGraph::start_vertex()
+{
+  return Ids[0];
+}
+
+
+//
+// do_work: solves the work in the given vertex, i.e. burns its cost, and
+// returns the ids of its neighbors. Safe to call from multiple threads.
+//
+std::vector<int> WorkGraph::do_work(int vertex)
+{
+  auto it = Index.find(vertex);
+
+  if (it == Index.end())
+  {
+    cout << "**Error in WorkGraph::do_work(): invalid vertex(" << vertex << ")" << endl;
+    Invalid = true;
+    return std::vector<int>();
+  }
+
+  int v = it->second;
+
+  Sink.store(Burn(Options, Costs[v]), memory_order_relaxed);
+  Executed[v].fetch_add(1, memory_order_relaxed);
+
+  std::vector<int> neighbors;
+  neighbors.reserve(Offsets[v + 1] - Offsets[v]);
+
+  for (long e = Offsets[v]; e < Offsets[v + 1]; e++)
+    neighbors.push_back(Ids[Targets[e]]);
+
+  return neighbors;
+}
+
+
+//
+// BuildEdges: fills adj[v] with the out-neighbors of each vertex index v,
+// for the given topology, such that every vertex is reachable from index 0.
+// Duplicates are fine, they're removed by the caller.
+//
+static void BuildEdges(const string& topology, int n, mt19937_64& rng, vector<vector<int>>& adj)
+{
+  auto below = [&](int i) {  // uniform in [0, i)
+    return uniform_int_distribution<int>(0, i - 1)(rng);
+  };
+
+  if (topology == "chain")
+  {
+    for (int v = 0; v + 1 < n; v++)
+      adj[v].push_back(v + 1);
+  }
+  else if (topology == "grid")
+  {
+    int cols = (int) ceil(sqrt((double) n));
+
+    for (int v = 0; v < n; v++)
+    {
+      int c = v % cols;
+
+      if (c > 0)                      adj[v].push_back(v - 1);
+      if (c + 1 < cols && v + 1 < n)  adj[v].push_back(v + 1);
+      if (v >= cols)                  adj[v].push_back(v - cols);
+      if (v + cols < n)               adj[v].push_back(v + cols);
+    }
+  }
+  else if (topology == "powerlaw")
+  {
+    //
+    // ends holds both endpoints of every edge so far, so a uniform pick
+    // from it is a pick by degree (+1 per vertex, so new ones can be
+    // picked at all):
+    //
+    const int m = 3;
+    vector<int> ends = { 0 };
+
+    for (int v = 1; v < n; v++)
+    {
+      int parent = ends[below((int) ends.size())];
+      adj[parent].push_back(v);
+      ends.push_back(parent);
+
+      for (int k = 0; k < m; k++)
+      {
+        int u = ends[below((int) ends.size())];
+        adj[v].push_back(u);
+        ends.push_back(u);
+      }
+
+      ends.push_back(v);
+    }
+  }
+  else  // random, dense: a random tree, then extra edges anywhere
+  {
+    int extra = (topology == "dense") ? 64 : 3;
+
+    for (int v = 1; v < n; v++)
+      adj[below(v)].push_back(v);
+
+    for (int v = 0; v < n; v++)
+      for (int k = 0; k < extra; k++)
+        adj[v].push_back(below(n));
+  }
+}
+
+
+//
+// WorkInstance: names this graph, for checkpoints (see checkpoint.h); the
+// same size, topology and options always give the same graph, ids and all.
+//
+extern "C" const char* WorkInstance()
+{
+  return Instance.c_str();
+}
+
+
+//
+// WorkCredit: counts vertex item (an id) as solved by an earlier run, which
+// was checkpointed and is now being resumed.
+//
+extern "C" void WorkCredit(long item)
+{
+  auto it = Index.find((int) item);
+
+  if (it == Index.end())
+  {
+    cout << "**Error in WorkCredit(): invalid vertex(" << item << ")" << endl;
+    Invalid = true;
+    return;
+  }
+
+  Executed[it->second].fetch_add(1, memory_order_relaxed);
+}
@@ -0,0 +1,444 @@
+/* bench.cpp */
+
+//
+// Scheduler shoot-out: runs the whole work matrix once under each
+// scheduling policy we'd consider, and reports for each
+//
+//   makespan    wall time for the whole matrix
+//   eff         work time / (threads * makespan), 100% is perfect
+//   idle avg    per-thread time not spent in do_work(), averaged over the
+//   idle max      threads and for the worst thread: scheduling overhead
+//               plus waiting at the end for the slowest thread
+//   ovh/cell    scheduling overhead per cell: the time each thread spent
+//               outside do_work() up to the end of its last cell (getting
+//               cells, locks, stealing), summed and divided by the cells;
+//               waiting at the end for the others isn't counted
+//   check       whether the WorkMatrix saw every cell solved exactly once
+//
+// Policies are OpenMP static, dynamic,k and guided, taskloop, a work-
+// stealing pool and a central atomic counter, over cells (the two loops
+// collapsed) or over whole rows.
+//
+// Build with "make bench", against the synthetic WorkMatrix (see
+// synthetic.h) so every policy gets exactly the same costs; the WORK_*
+// environment variables select the workload, e.g. WORK_MEAN=0 measures
+// pure scheduling overhead. A fresh WorkMatrix is created per policy.
+//
+// Usage:
+//   bench [-?] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-only substring]
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <omp.h>
+
+#include "workmatrix.h"
+#include "affinity.h"
+
+using namespace std;
+
+
+//
+// Per-thread measurements, padded so threads don't share cache lines:
+//
+struct alignas(64) ThreadStats {
+	double busy = 0.0;   // secs inside do_work()
+	double last = 0.0;   // end of the last cell, secs since the start
+	long   cells = 0;
+};
+
+struct Policy {
+	string name;
+	string grain;  // "cell" or "row"
+	function<void(WorkMatrix&, int, vector<ThreadStats>&)> run;
+};
+
+
+//
+// Globals:
+//
+static int _numThreads = 1;
+static string _only = "";  // run only policies whose name contains this
+
+static chrono::steady_clock::time_point _start;
+
+
+//
+// Function prototypes:
+//
+static void ProcessCmdLineArgs(int argc, char* argv[]);
+static vector<Policy> Policies();
+static void Steal(WorkMatrix& wm, int T, vector<ThreadStats>& stats);
+
+
+//
+// Seconds: since the start of the current run.
+//
+static inline double Seconds()
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - _start).count();
+}
+
+
+//
+// Solve: solves cell [r][c] on the calling thread, timing it.
+//
+static inline void Solve(WorkMatrix& wm, int r, int c, ThreadStats& s)
+{
+	double t0 = Seconds();
+	wm.do_work(r, c);
+	double t1 = Seconds();
+
+	s.busy += t1 - t0;
+	s.last = t1;
+	s.cells++;
+}
+
+
+//
+// main:
+//
+int main(int argc, char* argv[])
+{
+	cout << "** Work Matrix Scheduler Benchmark **" << endl;
+	cout << endl;
+
+	ProcessCmdLineArgs(argc, argv);
+
+	cout << "# of threads: " << _numThreads << endl;
+	Affinity::Report(_numThreads);
+
+	Affinity::BindOpenMP(_numThreads);
+
+	bool first = true;
+
+	for (const Policy& p : Policies())
+	{
+		if (_only != "" && p.name.find(_only) == string::npos)
+			continue;
+
+		//
+		// the WorkMatrix reports on itself when created and destroyed, so
+		// capture that: the description goes above the table, once, and the
+		// verdict goes in the check column:
+		//
+		ostringstream messages;
+		streambuf* saved = cout.rdbuf(messages.rdbuf());
+
+		vector<ThreadStats> stats(_numThreads);
+		double makespan;
+		int cells;
+
+		{
+			WorkMatrix wm;
+			cells = wm.num_rows() * wm.num_cols();
+
+			_start = chrono::steady_clock::now();
+			p.run(wm, _numThreads, stats);
+			makespan = Seconds();
+		}
+
+		cout.rdbuf(saved);
+
+		string text = messages.str();
+		if (first)
+		{
+			string line = text.substr(0, text.find('\n'));
+			if (line.compare(0, 2, "**") != 0)
+				cout << line << endl;
+
+			cout << endl;
+			cout << left << setw(22) << "policy" << setw(6) << "grain"
+			     << right << setw(11) << "makespan" << setw(8) << "eff"
+			     << setw(11) << "idle avg" << setw(11) << "idle max"
+			     << setw(12) << "ovh/cell" << "  check" << endl;
+
+			first = false;
+		}
+
+		double busy = 0.0, idleMax = 0.0, overhead = 0.0;
+
+		for (const ThreadStats& s : stats)
+		{
+			busy += s.busy;
+			idleMax = max(idleMax, makespan - s.busy);
+			overhead += s.last - s.busy;
+		}
+
+		double idleAvg = makespan - busy / _numThreads;
+
+		cout << left << setw(22) << p.name << setw(6) << p.grain << right << fixed
+		     << setw(9) << setprecision(3) << makespan << " s"
+		     << setw(7) << setprecision(1) << 100.0 * busy / (_numThreads * makespan) << "%"
+		     << setw(9) << setprecision(3) << idleAvg << " s"
+		     << setw(9) << setprecision(3) << idleMax << " s"
+		     << setw(9) << setprecision(2) << 1e6 * overhead / cells << " us"
+		     << "  " << (text.find("properly solved") != string::npos ? "ok" : "FAILED") << endl;
+	}
+
+	cout << endl;
+	cout << "** Execution complete **" << endl;
+	cout << endl;
+
+	return 0;
+}
+
+
+//
+// Policies: the schedules to compare.
+//
+static vector<Policy> Policies()
+{
+	vector<Policy> policies;
+
+	//
+	// OpenMP worksharing loops, over cells and over rows; the schedule is
+	// chosen at runtime (schedule(runtime)) so one loop serves them all:
+	//
+	struct Schedule { string name; omp_sched_t kind; int chunk; };
+
+	vector<Schedule> schedules = {
+		{ "static",       omp_sched_static,  0 },
+		{ "dynamic,1",    omp_sched_dynamic, 1 },
+		{ "dynamic,2",    omp_sched_dynamic, 2 },
+		{ "dynamic,4",    omp_sched_dynamic, 4 },
+		{ "dynamic,8",    omp_sched_dynamic, 8 },
+		{ "dynamic,16",   omp_sched_dynamic, 16 },
+		{ "dynamic,32",   omp_sched_dynamic, 32 },
+		{ "dynamic,64",   omp_sched_dynamic, 64 },
+		{ "guided",       omp_sched_guided,  0 },
+	};
+
+	for (const Schedule& s : schedules)
+	{
+		policies.push_back({ "omp " + s.name, "cell", [s](WorkMatrix& wm, int T, vector<ThreadStats>& stats) {
+			omp_set_schedule(s.kind, s.chunk);
+			int rows = wm.num_rows(), cols = wm.num_cols();
+
+			#pragma omp parallel for collapse(2) schedule(runtime) num_threads(T)
+			for (int r = 0; r < rows; r++)
+				for (int c = 0; c < cols; c++)
+					Solve(wm, r, c, stats[omp_get_thread_num()]);
+		}});
+	}
+
+	for (const Schedule& s : schedules)
+	{
+		if (s.kind == omp_sched_dynamic && s.chunk > 1)  // rows are big chunks already
+			continue;
+
+		policies.push_back({ "omp " + s.name, "row", [s](WorkMatrix& wm, int T, vector<ThreadStats>& stats) {
+			omp_set_schedule(s.kind, s.chunk);
+			int rows = wm.num_rows(), cols = wm.num_cols();
+
+			#pragma omp parallel for schedule(runtime) num_threads(T)
+			for (int r = 0; r < rows; r++)
+				for (int c = 0; c < cols; c++)
+					Solve(wm, r, c, stats[omp_get_thread_num()]);
+		}});
+	}
+
+	//
+	// OpenMP tasks: one thread creates the tasks, in chunks picked by the
+	// runtime or 8 cells each, and the others run them:
+	//
+	for (int grain : { 0, 8 })
+	{
+		string name = (grain == 0) ? "omp taskloop" : "omp taskloop,8";
+
+		policies.push_back({ name, "cell", [grain](WorkMatrix& wm, int T, vector<ThreadStats>& stats) {
+			int rows = wm.num_rows(), cols = wm.num_cols();
+			int cells = rows * cols;
+
+			#pragma omp parallel num_threads(T)
+			#pragma omp single
+			{
+				if (grain == 0)
+				{
+					#pragma omp taskloop
+					for (int cell = 0; cell < cells; cell++)
+						Solve(wm, cell / cols, cell % cols, stats[omp_get_thread_num()]);
+				}
+				else
+				{
+					#pragma omp taskloop grainsize(8)
+					for (int cell = 0; cell < cells; cell++)
+						Solve(wm, cell / cols, cell % cols, stats[omp_get_thread_num()]);
+				}
+			}
+		}});
+	}
+
+	//
+	// central dispenser: every thread takes the next cell (or row) from one
+	// shared atomic counter:
+	//
+	policies.push_back({ "atomic counter", "cell", [](WorkMatrix& wm, int T, vector<ThreadStats>& stats) {
+		int rows = wm.num_rows(), cols = wm.num_cols();
+		int cells = rows * cols;
+		atomic<int> next(0);
+
+		#pragma omp parallel num_threads(T)
+		{
+			ThreadStats& s = stats[omp_get_thread_num()];
+
+			for (int cell = next++; cell < cells; cell = next++)
+				Solve(wm, cell / cols, cell % cols, s);
+		}
+	}});
+
+	policies.push_back({ "atomic counter", "row", [](WorkMatrix& wm, int T, vector<ThreadStats>& stats) {
+		int rows = wm.num_rows(), cols = wm.num_cols();
+		atomic<int> next(0);
+
+		#pragma omp parallel num_threads(T)
+		{
+			ThreadStats& s = stats[omp_get_thread_num()];
+
+			for (int r = next++; r < rows; r = next++)
+				for (int c = 0; c < cols; c++)
+					Solve(wm, r, c, s);
+		}
+	}});
+
+	policies.push_back({ "work stealing", "cell", Steal });
+
+	return policies;
+}
+
+
+//
+// Steal:
+//
+// Work-stealing pool: each thread starts with a contiguous range of cells
+// and takes cells one at a time from the front of it; a thread whose range
+// is empty steals the back half of another thread's range, trying the
+// others in turn. No new work is ever created, so once a thread finds
+// every range empty, it's done (cells in transit to a thief will be
+// solved by the thief).
+//
+static void Steal(WorkMatrix& wm, int T, vector<ThreadStats>& stats)
+{
+	struct alignas(64) Range {
+		mutex lock;
+		int   begin = 0;
+		int   end = 0;
+	};
+
+	int cols = wm.num_cols();
+	int cells = wm.num_rows() * cols;
+	vector<Range> ranges(T);
+
+	for (int t = 0; t < T; t++)
+	{
+		ranges[t].begin = (int) ((long) cells * t / T);
+		ranges[t].end = (int) ((long) cells * (t + 1) / T);
+	}
+
+	#pragma omp parallel num_threads(T)
+	{
+		int me = omp_get_thread_num();
+		Range& mine = ranges[me];
+		ThreadStats& s = stats[me];
+
+		while (true)
+		{
+			int cell = -1;
+
+			{
+				lock_guard<mutex> guard(mine.lock);
+				if (mine.begin < mine.end)
+					cell = mine.begin++;
+			}
+
+			if (cell >= 0)
+			{
+				Solve(wm, cell / cols, cell % cols, s);
+				continue;
+			}
+
+			//
+			// out of work, steal half of someone else's:
+			//
+			int begin = 0, end = 0;
+
+			for (int i = 1; i < T && begin == end; i++)
+			{
+				Range& victim = ranges[(me + i) % T];
+				lock_guard<mutex> guard(victim.lock);
+
+				int left = victim.end - victim.begin;
+				if (left > 0)
+				{
+					end = victim.end;
+					begin = victim.end - (left + 1) / 2;
+					victim.end = begin;
+				}
+			}
+
+			if (begin == end)  // everyone's empty:
+				break;
+
+			lock_guard<mutex> guard(mine.lock);
+			mine.begin = begin;
+			mine.end = end;
+		}
+	}
+}
+
+
+//
+// processCmdLineArgs:
+//
+static void ProcessCmdLineArgs(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+
+		if (strcmp(argv[i], "-?") == 0)  // help:
+		{
+			cout << "**Usage: bench [-?] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-only substring]" << endl << endl;
+			exit(0);
+		}
+		else if ((strcmp(argv[i], "-t") == 0) && (i+1 < argc))  // # of threads:
+		{
+			i++;
+			_numThreads = atoi(argv[i]);
+		}
+		else if ((strcmp(argv[i], "-bind") == 0) && (i+1 < argc))  // thread placement:
+		{
+			i++;
+
+			if (!Affinity::SetPolicy(argv[i]))
+			{
+				cout << "**Unknown bind policy: '" << argv[i] << "'" << endl;
+				cout << "**Usage: bench [-?] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-only substring]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-only") == 0) && (i+1 < argc))  // subset of policies:
+		{
+			i++;
+			_only = argv[i];
+		}
+		else  // error: unknown arg
+		{
+			cout << "**Unknown argument: '" << argv[i] << "'" << endl;
+			cout << "**Usage: bench [-?] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-only substring]" << endl << endl;
+			exit(0);
+		}
+
+	}//for
+
+	if (_numThreads < 1)
+		_numThreads = 1;
+}
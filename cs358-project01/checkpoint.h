@@ -0,0 +1,179 @@
+/*checkpoint.h*/
+
+//
+// Periodic, asynchronous checkpoints of a long run, so a restarted run can
+// resume where the last one left off.
+//
+// A Checkpointer owns a background thread that, every few seconds, asks the
+// caller for a snapshot (a string of bytes) and writes it to the checkpoint
+// file. The snapshot function runs on the background thread, so it must
+// only read state the workers update atomically (e.g. a bitmap of atomic
+// words); workers are never stopped. The file is written to path.tmp and
+// renamed over path, so a crash mid-write leaves the previous checkpoint
+// intact.
+//
+// Put and Get (de)serialize plain values, in the machine's byte order,
+// and strings.
+//
+// A checkpoint is only good for the same instance of the work, and the
+// work itself (WorkMatrix / WorkGraph) only counts items solved by this
+// process. The synthetic implementations (see synthetic.h) therefore also
+// define:
+//
+//   WorkInstance()    names the instance: size, shape, seed and costs, so
+//                     equal names mean the same work
+//   WorkCredit(item)  counts item (a cell r*cols+c, or a vertex id) as
+//                     solved by an earlier run
+//
+// The prebuilt workmatrix.o / workgraph.o draw a new instance every run and
+// have neither, so the declarations are weak: linked against those, both
+// are null, and there is nothing to resume.
+//
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+
+extern "C" const char* WorkInstance() __attribute__((weak));
+extern "C" void WorkCredit(long item) __attribute__((weak));
+
+class Checkpointer {
+    public:
+
+      Checkpointer(const std::string& path, double seconds, std::function<std::string()> snapshot)
+        : path(path), seconds(seconds), snapshot(snapshot), stopping(false), writes(0)
+      {
+        writer = std::thread([this]() { Run(); });
+      }
+
+      //
+      // stops the background thread; call Save afterwards for a final
+      // checkpoint, or Remove if the run completed:
+      //
+      ~Checkpointer()
+      {
+        {
+          std::lock_guard<std::mutex> lock(m);
+          stopping = true;
+        }
+        cv.notify_one();
+        writer.join();
+      }
+
+      // # of checkpoints written so far:
+      int count() const { return writes; }
+
+      //
+      // Save: writes bytes to path, atomically replacing the old checkpoint;
+      // returns false if the file could not be written:
+      //
+      static bool Save(const std::string& path, const std::string& bytes)
+      {
+        std::string tmp = path + ".tmp";
+        {
+          std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+          out.write(bytes.data(), bytes.size());
+          if (!out.good())
+            return false;
+        }
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+      }
+
+      //
+      // Load: reads the checkpoint at path into bytes; returns false if
+      // there is none:
+      //
+      static bool Load(const std::string& path, std::string& bytes)
+      {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.good())
+          return false;
+
+        std::stringstream ss;
+        ss << in.rdbuf();
+        bytes = ss.str();
+        return true;
+      }
+
+      // Remove: deletes the checkpoint, e.g. once the run is complete:
+      static void Remove(const std::string& path)
+      {
+        std::remove(path.c_str());
+      }
+
+      //
+      // Put: appends the bytes of value to bytes; Get: reads a value at
+      // offset pos, advancing pos, and returns false if bytes is too short:
+      //
+      template <class T> static void Put(std::string& bytes, const T& value)
+      {
+        bytes.append((const char*) &value, sizeof(T));
+      }
+
+      template <class T> static bool Get(const std::string& bytes, size_t& pos, T& value)
+      {
+        if (pos + sizeof(T) > bytes.size())
+          return false;
+
+        bytes.copy((char*) &value, sizeof(T), pos);
+        pos += sizeof(T);
+        return true;
+      }
+
+      // strings are stored as their length, then their characters:
+      static void Put(std::string& bytes, const std::string& value)
+      {
+        Put(bytes, (int) value.size());
+        bytes.append(value);
+      }
+
+      static bool Get(const std::string& bytes, size_t& pos, std::string& value)
+      {
+        int n = 0;
+        if (!Get(bytes, pos, n) || n < 0 || pos + n > bytes.size())
+          return false;
+
+        value = bytes.substr(pos, n);
+        pos += n;
+        return true;
+      }
+
+    private:
+
+      std::string                   path;
+      double                        seconds;
+      std::function<std::string()>  snapshot;
+
+      std::thread                   writer;
+      std::mutex                    m;
+      std::condition_variable       cv;
+      bool                          stopping;
+      std::atomic<int>              writes;
+
+      void Run()
+      {
+        std::unique_lock<std::mutex> lock(m);
+
+        while (!cv.wait_for(lock, std::chrono::duration<double>(seconds), [this]() { return stopping; }))
+        {
+          lock.unlock();  // don't hold the lock while writing
+
+          if (Save(path, snapshot()))
+            writes++;
+          else
+            std::cout << "**WARNING: unable to write checkpoint '" << path << "'" << std::endl;
+
+          lock.lock();
+        }
+      }
+};
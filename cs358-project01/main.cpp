@@ -6,7 +6,7 @@
 // but doesn't scale. A much more dynamic solution is needed.
 // 
 // Usage:
-//   work [-?] [-t NumThreads]
+//   work [-?] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-trace file.json] [-checkpoint file] [-resume]
 //
 // Author:
 //   << Theo Maurino >>
@@ -20,11 +20,17 @@
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <atomic>
+#include <cstdint>
 #include <chrono>
 #include <sys/sysinfo.h>
+#include <omp.h>
 
 #include "alloc2D.h"
 #include "workmatrix.h"
+#include "affinity.h"
+#include "trace.h"
+#include "checkpoint.h"
 
 using namespace std;
 
@@ -34,11 +40,16 @@ using namespace std;
 //
 static int _numThreads = 1;  // default to sequential execution
 static int cells = 0;
+static string _traceFile = "";  // Chrome trace output, if any
+static string _checkpointFile = "";  // periodic checkpoints, if any
+static bool _resume = false;  // skip cells finished in the checkpoint?
 
 //
 // Function prototypes:
 //
 static void ProcessCmdLineArgs(int argc, char* argv[]); // :)
+static string Snapshot(int rows, int cols, atomic<uint64_t>* finished);
+static int Resume(const string& path, int rows, int cols, atomic<uint64_t>* finished);
 
 
 
@@ -60,8 +71,34 @@ int main(int argc, char *argv[])
 
 	cout << "Matrix size:  " << wm.num_rows() << "x" << wm.num_cols() << endl;
 	cout << "# of threads: " << _numThreads << endl;
+	Affinity::Report(_numThreads);
 	cout << endl;
 
+	Affinity::BindOpenMP(_numThreads);
+
+	if (_traceFile != "")
+		Trace::Enable(_numThreads);
+
+	//
+	// finished cells, one bit per cell, row-major; with -resume, start from
+	// the bits in the checkpoint, and with -checkpoint, save them every few
+	// seconds in the background:
+	//
+	int rows = wm.num_rows(), cols = wm.num_cols();
+	int num_words = (rows * cols + 63) / 64;
+	atomic<uint64_t>* finished = new atomic<uint64_t>[num_words];
+
+	for (int w = 0; w < num_words; w++)
+		finished[w] = 0;
+
+	if (_resume)
+		cells = Resume(_checkpointFile, rows, cols, finished);
+
+	Checkpointer* checkpointer = nullptr;
+	if (_checkpointFile != "")
+		checkpointer = new Checkpointer(_checkpointFile, 5.0,
+			[=]() { return Snapshot(rows, cols, finished); });
+
 	cout << "working";
 	cout.flush();
 
@@ -76,11 +113,35 @@ int main(int argc, char *argv[])
 
 //#pragma omp parallel for num_threads(_numThreads) collapse(2) /// parallelize the loop using all the threads we have avalable --> turns out num_threads not rly needed if using max
 #pragma omp parallel for collapse(2) schedule(dynamic, 8) num_threads(_numThreads)
-	// testing shows
+	// testing shows (hand timings of the real workmatrix.o, this schedule)
 	// 1 thread -- ~ 160s
 	// 2 thread -- ~ 80s
 	// 4 thread -- ~ 41s
 	// 8 thread -- ~ 19s
+	//
+	// NOTE: these hand timings are still all we have for picking dynamic,8.
+	// bench.cpp ("make bench") is meant to replace them with a comparison of
+	// every schedule's load balance: ./bench -t 2, 4 and 8 with the real
+	// cost model (WORK_MEAN unset), reading the makespan and idle columns.
+	// That needs a multi-core machine and hasn't been run yet.
+	//
+	// The one bench run so far only measures per-cell scheduling overhead,
+	// with zero-cost cells (WORK_MEAN=0 WORK_SIZE=1000x1000 ./bench -t 1, on
+	// a 1-core machine):
+	//
+	//   policy            grain   makespan   ovh/cell
+	//   omp static        cell    0.216 s    0.06 us
+	//   omp dynamic,1     cell    0.246 s    0.07 us
+	//   omp dynamic,8     cell    0.204 s    0.05 us
+	//   omp guided        cell    0.196 s    0.05 us
+	//   omp dynamic,1     row     0.203 s    0.05 us
+	//   omp taskloop      cell    0.199 s    0.05 us
+	//   atomic counter    cell    0.211 s    0.06 us
+	//   work stealing     cell    0.200 s    0.05 us
+	//
+	// i.e. overhead is negligible next to real cells under every schedule,
+	// so it can't be what decides between them.
+	//
 	// this parallelization scheme flattens the for loops so they run as one for loop (collapse(2))
 	// it then allows the threads to schedule their workloads dynamically to account for difference in workload for different cells -- schedule(dynamic, 8)
 		// if one thread finishes its (collection of 8) task(s), it can request a new (collection of 8) task(s)
@@ -90,10 +151,22 @@ int main(int argc, char *argv[])
 
 		for (int c = 0; c < wm.num_cols(); c++) {
 
+			int cell = r * cols + c;
+			uint64_t bit = 1ULL << (cell % 64);
+
+			if (finished[cell / 64].load(memory_order_relaxed) & bit)  // done before we resumed
+				continue;
+
 			//
-			// this solves the work in cell [r][c]:
+			// this solves the work in cell [r][c] (and with -trace, records
+			// when, and on which thread):
 			//
+			double trace_start = Trace::Now();
+
 			wm.do_work(r, c);
+			Trace::Record(omp_get_thread_num(), "do_work", trace_start, Trace::Now(), "row", r, "col", c);
+
+			finished[cell / 64].fetch_or(bit, memory_order_relaxed);
 
 			//
 			// show some output every 100 cells so we see progress:
@@ -108,6 +181,7 @@ int main(int argc, char *argv[])
 	}
   
   auto stop = chrono::high_resolution_clock::now();
+	Trace::IdleUntil(Trace::Now());  // threads that ran out of cells early
   auto diff = stop - start;
   auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
 
@@ -116,6 +190,22 @@ int main(int argc, char *argv[])
 
   cout << endl;
   cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
+
+	if (_traceFile != "")
+		Trace::Write(_traceFile);
+
+	//
+	// every cell is done, so the checkpoint is no longer needed:
+	//
+	if (checkpointer != nullptr)
+	{
+		cout << "Checkpoints written: " << checkpointer->count() << endl;
+		delete checkpointer;
+		Checkpointer::Remove(_checkpointFile);
+	}
+
+	delete[] finished;
+
 	cout << "** Execution complete **" << endl;
   cout << endl;
 
@@ -133,7 +223,7 @@ static void ProcessCmdLineArgs(int argc, char* argv[])
 
 		if (strcmp(argv[i], "-?") == 0)  // help:
 		{
-			cout << "**Usage: work [-?] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: work [-?] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-trace file.json] [-checkpoint file] [-resume]" << endl << endl;
 			exit(0);
 		}
 		else if ((strcmp(argv[i], "-t") == 0) && (i+1 < argc))  // # of threads:
@@ -141,12 +231,120 @@ static void ProcessCmdLineArgs(int argc, char* argv[])
 			i++;
 			_numThreads = atoi(argv[i]);
 		}
+		else if ((strcmp(argv[i], "-bind") == 0) && (i+1 < argc))  // thread placement:
+		{
+			i++;
+
+			if (!Affinity::SetPolicy(argv[i]))
+			{
+				cout << "**Unknown bind policy: '" << argv[i] << "'" << endl;
+				cout << "**Usage: work [-?] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-trace file.json] [-checkpoint file] [-resume]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-trace") == 0) && (i+1 < argc))  // timeline output:
+		{
+			i++;
+			_traceFile = argv[i];
+		}
+		else if ((strcmp(argv[i], "-checkpoint") == 0) && (i+1 < argc))  // checkpoint file:
+		{
+			i++;
+			_checkpointFile = argv[i];
+		}
+		else if (strcmp(argv[i], "-resume") == 0)  // resume from checkpoint:
+		{
+			_resume = true;
+		}
 		else  // error: unknown arg
 		{
 			cout << "**Unknown argument: '" << argv[i] << "'" << endl;
-			cout << "**Usage: work [-?] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: work [-?] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-trace file.json] [-checkpoint file] [-resume]" << endl << endl;
 			exit(0);
 		}
 
 	}//for
+
+	if (_resume && _checkpointFile == "")
+		_checkpointFile = "work.ckpt";
+
+	if (_checkpointFile != "" && WorkInstance == nullptr)
+	{
+		cout << "**-checkpoint and -resume need a work matrix that can be rebuilt exactly, i.e. the" << endl;
+		cout << "  synthetic one (make synthetic); workmatrix.o draws a new matrix every run" << endl << endl;
+		exit(0);
+	}
+}
+
+
+//
+// Snapshot:
+//
+// The checkpoint: "WMCK", the matrix's name (see WorkInstance in
+// checkpoint.h), rows, cols, then the bitmap of finished cells. Runs on the
+// checkpoint thread while workers are setting bits, so a bit may be missed;
+// the cell is then just redone after a resume.
+//
+static string Snapshot(int rows, int cols, atomic<uint64_t>* finished)
+{
+	string bytes = "WMCK";
+	int num_words = (rows * cols + 63) / 64;
+
+	Checkpointer::Put(bytes, string(WorkInstance()));
+	Checkpointer::Put(bytes, rows);
+	Checkpointer::Put(bytes, cols);
+
+	for (int w = 0; w < num_words; w++)
+		Checkpointer::Put(bytes, finished[w].load(memory_order_relaxed));
+
+	return bytes;
+}
+
+
+//
+// Resume:
+//
+// Loads the finished-cell bitmap from the checkpoint at path, and credits
+// those cells to the work matrix (see WorkCredit in checkpoint.h), returning
+// the # of cells already finished (0 if there's no usable checkpoint).
+//
+static int Resume(const string& path, int rows, int cols, atomic<uint64_t>* finished)
+{
+	string bytes, instance;
+	size_t pos = 4;
+	int r = 0, c = 0;
+
+	if (!Checkpointer::Load(path, bytes))
+	{
+		cout << "Resume:       no checkpoint '" << path << "', starting from scratch" << endl;
+		return 0;
+	}
+
+	if (bytes.compare(0, 4, "WMCK") != 0 || !Checkpointer::Get(bytes, pos, instance) ||
+	    instance != WorkInstance() || !Checkpointer::Get(bytes, pos, r) ||
+	    !Checkpointer::Get(bytes, pos, c) || r != rows || c != cols)
+	{
+		cout << "Resume:       checkpoint '" << path << "' is not for this matrix, starting from scratch" << endl;
+		return 0;
+	}
+
+	int num_words = (rows * cols + 63) / 64;
+	int count = 0;
+
+	for (int w = 0; w < num_words; w++)
+	{
+		uint64_t word = 0;
+		if (!Checkpointer::Get(bytes, pos, word))
+			break;
+
+		finished[w] = word;
+		count += __builtin_popcountll(word);
+
+		for (int b = 0; b < 64; b++)
+			if (word & (1ULL << b))
+				WorkCredit((long) w * 64 + b);
+	}
+
+	cout << "Resume:       " << count << " of " << rows * cols << " cells already finished" << endl;
+	return count;
 }
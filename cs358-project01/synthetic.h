@@ -0,0 +1,171 @@
+/*synthetic.h*/
+
+//
+// Shared pieces of the synthetic WorkMatrix / WorkGraph implementations
+// (workmatrix-synthetic.cpp, workgraph-synthetic.cpp), drop-in stand-ins
+// for the prebuilt workmatrix.o / workgraph.o. Unlike those, everything is
+// generated from a seed, so the same options give the same workload run
+// after run, and schedulers can be compared fairly.
+//
+// The header files (workmatrix.h, workgraph.h) are unchanged, so options
+// come from the environment, read when the first WorkMatrix / WorkGraph is
+// constructed:
+//
+//   WORK_SEED=n          seed for costs and shapes (default 1)
+//   WORK_COST=dist       cost distribution (default uniform):
+//                          uniform   uniform in [0, 2*mean]
+//                          bimodal   5% of the work items cost 10*mean,
+//                                    the rest a little over mean/2
+//                          pareto    heavy-tailed, alpha = 1.5 (capped at
+//                                    1000*mean)
+//                          rows      correlated: each row of the matrix
+//                                    (each block of 100 consecutive vertices
+//                                    of the graph) has its own exponentially
+//                                    distributed scale, then +-50% per item
+//   WORK_MEAN=secs       mean cost of a work item (default 0.001)
+//   WORK_BURN=kind       how cost is spent (default spin):
+//                          spin      busy-wait on the clock for the cost
+//                          flops     cost * WORK_RATE multiply-adds, the
+//                                    same count on every machine
+//   WORK_RATE=n          multiply-adds per second of cost (default 1e9)
+//
+// plus WORK_SIZE=RxC (matrix) and WORK_VERTICES=n, WORK_TOPOLOGY=kind
+// (graph), see the .cpp files.
+//
+// Each run prints one line with the options in effect.
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+struct SyntheticOptions {
+  unsigned long seed = 1;
+  std::string   cost = "uniform";
+  double        mean = 0.001;
+  std::string   burn = "spin";
+  double        rate = 1e9;
+
+  //
+  // Read: options from the environment; unknown values are an error:
+  //
+  void Read()
+  {
+    if (const char* s = std::getenv("WORK_SEED"))  seed = std::strtoul(s, nullptr, 10);
+    if (const char* s = std::getenv("WORK_COST"))  cost = s;
+    if (const char* s = std::getenv("WORK_MEAN"))  mean = std::atof(s);
+    if (const char* s = std::getenv("WORK_BURN"))  burn = s;
+    if (const char* s = std::getenv("WORK_RATE"))  rate = std::atof(s);
+
+    if (cost != "uniform" && cost != "bimodal" && cost != "pareto" && cost != "rows")
+    {
+      std::cout << "**Error: WORK_COST must be uniform, bimodal, pareto or rows: '" << cost << "'" << std::endl;
+      std::exit(0);
+    }
+
+    if (burn != "spin" && burn != "flops")
+    {
+      std::cout << "**Error: WORK_BURN must be spin or flops: '" << burn << "'" << std::endl;
+      std::exit(0);
+    }
+
+    if (mean < 0.0 || rate <= 0.0)
+    {
+      std::cout << "**Error: WORK_MEAN must be >= 0 and WORK_RATE > 0" << std::endl;
+      std::exit(0);
+    }
+  }
+
+  std::string Describe() const
+  {
+    return "seed " + std::to_string(seed) + ", " + cost + " costs, mean "
+      + std::to_string(mean) + " secs, " + burn;
+  }
+};
+
+
+//
+// SyntheticCosts: n costs (in secs) drawn from the distribution in opt;
+// for "rows", items g*groupSize .. (g+1)*groupSize-1 share a scale.
+//
+inline std::vector<float> SyntheticCosts(const SyntheticOptions& opt, long n, long groupSize, std::mt19937_64& rng)
+{
+  std::vector<float> costs(n);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  const double mean = opt.mean;
+  double scale = 1.0;
+
+  for (long i = 0; i < n; i++)
+  {
+    double u = unit(rng);
+    double c;
+
+    if (opt.cost == "uniform")
+      c = 2.0 * mean * u;
+    else if (opt.cost == "bimodal")
+    {
+      const double p = 0.05, heavy = 10.0;  // mean stays mean
+      c = (u < p) ? heavy * mean : mean * (1.0 - p * heavy) / (1.0 - p);
+    }
+    else if (opt.cost == "pareto")
+    {
+      const double alpha = 1.5;
+      double xm = mean * (alpha - 1.0) / alpha;
+      c = std::min(xm / std::pow(1.0 - u, 1.0 / alpha), 1000.0 * mean);
+    }
+    else  // rows
+    {
+      if (i % groupSize == 0)
+        scale = -std::log(1.0 - unit(rng));  // exponential, mean 1
+      c = mean * scale * (0.5 + u);
+    }
+
+    costs[i] = (float) c;
+  }
+
+  return costs;
+}
+
+
+//
+// Burn: spends secs of work, by spinning on the clock or by a fixed number
+// of multiply-adds (see WORK_BURN). Returns a value derived from the work,
+// so the compiler can't drop it.
+//
+inline double Burn(const SyntheticOptions& opt, double secs)
+{
+  if (opt.burn == "spin")
+  {
+    auto start = std::chrono::steady_clock::now();
+    long spins = 0;
+
+    while (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < secs)
+      spins++;
+
+    return (double) spins;
+  }
+
+  //
+  // flops: 4 independent chains of multiply-adds, converging to 1.0:
+  //
+  long n = (long) (secs * opt.rate / 4.0);
+  double x0 = 0.0, x1 = 0.1, x2 = 0.2, x3 = 0.3;
+
+  for (long i = 0; i < n; i++)
+  {
+    x0 = x0 * 0.999999 + 0.000001;
+    x1 = x1 * 0.999999 + 0.000001;
+    x2 = x2 * 0.999999 + 0.000001;
+    x3 = x3 * 0.999999 + 0.000001;
+  }
+
+  return x0 + x1 + x2 + x3;
+}
@@ -0,0 +1,180 @@
+/*topology.h*/
+
+//
+// CPU topology of the machine, as far as scheduling cares: which NUMA node
+// (socket), which core complex (CPUs sharing an L3 cache), and which
+// physical core (SMT siblings) each CPU is in.
+//
+// Nodes come from /sys/devices/system/node/nodeN/cpulist, complexes from
+// /sys/devices/system/cpu/cpuN/cache/index3/id, cores from
+// /sys/devices/system/cpu/cpuN/topology. Any may be missing (e.g. in a
+// container), in which case everything is one node, a CPU's complex is its
+// node, and every CPU is its own core. Only the CPUs this process may run
+// on are listed, ordered node by node, complex by complex, core by core,
+// so consecutive positions are as close as possible.
+//
+
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <sched.h>
+
+class Topology {
+    public:
+
+      Topology()
+      {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        sched_getaffinity(0, sizeof(allowed), &allowed);
+
+        //
+        // nodes, if the kernel exposes them:
+        //
+        std::vector<int> online = ParseList(ReadLine("/sys/devices/system/node/online"));
+
+        for (int node : online)
+        {
+          std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+
+          for (int cpu : ParseList(ReadLine(path)))
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+              Add(cpu, node);
+        }
+
+        if (cpus.empty())  // no sysfs, so one node:
+        {
+          for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &allowed))
+              Add(cpu, 0);
+        }
+
+        std::sort(cpus.begin(), cpus.end(),
+          [](const Cpu& a, const Cpu& b) {
+            if (a.node != b.node) return a.node < b.node;
+            if (a.complex != b.complex) return a.complex < b.complex;
+            if (a.core != b.core) return a.core < b.core;
+            return a.id < b.id;
+          });
+      }
+
+      // # of CPUs we may run on, and the i-th one in topology order:
+      int num_cpus() const { return (int) cpus.size(); }
+      int cpu(int i) const { return cpus[i].id; }
+
+      // node, core complex and physical core of the i-th CPU:
+      int node(int i) const { return cpus[i].node; }
+      int complex(int i) const { return cpus[i].complex; }
+      int core(int i) const { return cpus[i].core; }
+
+      // # of distinct nodes:
+      int num_nodes() const
+      {
+        int n = 0;
+        for (size_t i = 0; i < cpus.size(); i++)
+          if (i == 0 || cpus[i].node != cpus[i-1].node)
+            n++;
+        return n;
+      }
+
+      //
+      // distance between the i-th and j-th CPUs: 0 => same core complex,
+      // 1 => same node, 2 => remote node:
+      //
+      enum { SAME_COMPLEX = 0, SAME_NODE = 1, REMOTE = 2 };
+
+      int distance(int i, int j) const
+      {
+        if (cpus[i].node != cpus[j].node)
+          return REMOTE;
+        if (cpus[i].complex != cpus[j].complex)
+          return SAME_NODE;
+        return SAME_COMPLEX;
+      }
+
+      //
+      // pin: binds the calling thread to the i-th CPU; returns false if the
+      // kernel refuses:
+      //
+      bool pin(int i) const
+      {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[i].id, &set);
+
+        return sched_setaffinity(0, sizeof(set), &set) == 0;  // 0 => calling thread
+      }
+
+    private:
+
+      struct Cpu {
+        int id;
+        int node;
+        int complex;
+        int core;
+      };
+
+      std::vector<Cpu> cpus;
+
+      void Add(int cpu, int node)
+      {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        std::string l3 = ReadLine(dir + "/cache/index3/id");
+        std::string package = ReadLine(dir + "/topology/physical_package_id");
+        std::string core_id = ReadLine(dir + "/topology/core_id");
+
+        //
+        // L3 ids are only unique within a node, so make the complex id
+        // unique across nodes:
+        //
+        int complex = node * 1024 + (l3.empty() ? 0 : atoi(l3.c_str()) % 1024);
+
+        //
+        // likewise core ids are only unique within a package:
+        //
+        int core = core_id.empty() ? cpu : atoi(package.c_str()) * 65536 + atoi(core_id.c_str());
+
+        cpus.push_back(Cpu{ cpu, node, complex, core });
+      }
+
+      static std::string ReadLine(const std::string& path)
+      {
+        std::ifstream file(path);
+        std::string line;
+
+        if (file.good())
+          std::getline(file, line);
+
+        return line;
+      }
+
+      //
+      // ParseList: "0-3,8,10-11" => 0 1 2 3 8 10 11
+      //
+      static std::vector<int> ParseList(const std::string& list)
+      {
+        std::vector<int> result;
+        std::stringstream ss(list);
+        std::string range;
+
+        while (std::getline(ss, range, ','))
+        {
+          if (range.empty())
+            continue;
+
+          size_t dash = range.find('-');
+          int lo = atoi(range.c_str());
+          int hi = (dash == std::string::npos) ? lo : atoi(range.c_str() + dash + 1);
+
+          for (int i = lo; i <= hi; i++)
+            result.push_back(i);
+        }
+
+        return result;
+      }
+};
@@ -0,0 +1,198 @@
+/*workmatrix-synthetic.cpp*/
+
+//
+// Synthetic implementation of the WorkMatrix class (workmatrix.h), a
+// drop-in replacement for workmatrix.o whose costs come from a seed, so
+// runs can be repeated exactly. See synthetic.h for the options; also
+//
+//   WORK_SIZE=RxC        matrix size (default 102x102, as workmatrix.o)
+//
+// Build with "make synthetic", which links against this file in place of
+// workmatrix.o, e.g.
+//
+//   WORK_COST=pareto WORK_SEED=7 ./work-synthetic -t 4
+//
+// As with workmatrix.o, every cell must be solved exactly once, which is
+// checked when the last WorkMatrix is destroyed; cells solved before a
+// resume are credited with WorkCredit (see checkpoint.h).
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+
+#include "workmatrix.h"
+#include "synthetic.h"
+
+using namespace std;
+
+
+//
+// State shared by all copies of the WorkMatrix (copies share the one
+// matrix, like workmatrix.o); set up by the first constructor and checked
+// by the last destructor:
+//
+static int               refCount = 0;
+static int               NumRows = 0;
+static int               NumCols = 0;
+static SyntheticOptions  Options;
+static vector<float>     Costs;     // NumRows*NumCols, secs, row-major
+static atomic<int>*      Executed = nullptr;
+static atomic<bool>      OutOfBounds(false);
+static atomic<double>    Sink(0.0);  // keeps the burned work alive
+static string            Instance;  // see WorkInstance
+
+
+//
+// default constructor: must be called from sequential code.
+//
+WorkMatrix::WorkMatrix()
+{
+  if (refCount++ > 0)  // already set up:
+    return;
+
+  Options.Read();
+
+  NumRows = 102;
+  NumCols = 102;
+
+  if (const char* s = getenv("WORK_SIZE"))
+  {
+    if (sscanf(s, "%dx%d", &NumRows, &NumCols) != 2 || NumRows < 1 || NumCols < 1)
+    {
+      cout << "**Error: WORK_SIZE must be RxC, e.g. 102x102: '" << s << "'" << endl;
+      exit(0);
+    }
+  }
+
+  mt19937_64 rng(Options.seed);
+
+  Costs = SyntheticCosts(Options, (long) NumRows * NumCols, NumCols, rng);
+
+  Executed = new atomic<int>[(long) NumRows * NumCols];
+  for (long i = 0; i < (long) NumRows * NumCols; i++)
+    Executed[i] = 0;
+
+  OutOfBounds = false;
+
+  double total = 0.0;
+  for (float c : Costs)
+    total += c;
+
+  Instance = "matrix " + to_string(NumRows) + "x" + to_string(NumCols) + ", " + Options.Describe();
+
+  cout << "Synthetic:    " << NumRows << "x" << NumCols << ", " << Options.Describe()
+       << " (" << total << " secs of work)" << endl;
+}
+
+
+//
+// copy constructor: shares the matrix.
+//
+WorkMatrix::WorkMatrix(const WorkMatrix& other)
+{
+  refCount++;
+}
+
+
+//
+// destructor: when the last copy goes, checks that every cell was solved
+// exactly once.
+//
+WorkMatrix::~WorkMatrix()
+{
+  if (--refCount > 0)
+    return;
+
+  bool unsolved = false, multiple = false;
+
+  for (long i = 0; i < (long) NumRows * NumCols; i++)
+  {
+    if (Executed[i] == 0)
+      unsolved = true;
+    else if (Executed[i] > 1)
+      multiple = true;
+  }
+
+  if (unsolved)
+    cout << "** WorkMatrix results: at least one cell was not solved" << endl;
+  if (multiple)
+    cout << "** WorkMatrix results: at least one cell was solved multiple times" << endl;
+  if (!unsolved && !multiple && !OutOfBounds)
+    cout << "** WorkMatrix results: all cells properly solved!" << endl;
+
+  delete[] Executed;
+  Executed = nullptr;
+  Costs.clear();
+}
+
+
+int WorkMatrix::num_rows()
+{
+  return NumRows;
+}
+
+int WorkMatrix::num_cols()
+{
+  return NumCols;
+}
+
+
+//
+// do_work: solves the work in cell [row][col], i.e. burns its cost.
+// Safe to call from multiple threads.
+//
+bool WorkMatrix::do_work(int row, int col)
+{
+  if (row < 0 || row >= NumRows)
+  {
+    cout << "**Error in WorkMatrix::do_work(): row is out of bounds" << endl;
+    OutOfBounds = true;
+    return false;
+  }
+
+  if (col < 0 || col >= NumCols)
+  {
+    cout << "**Error in WorkMatrix::do_work(): col is out of bounds" << endl;
+    OutOfBounds = true;
+    return false;
+  }
+
+  long cell = (long) row * NumCols + col;
+
+  Sink.store(Burn(Options, Costs[cell]), memory_order_relaxed);
+  Executed[cell].fetch_add(1, memory_order_relaxed);
+
+  return true;
+}
+
+
+//
+// WorkInstance: names this matrix, for checkpoints (see checkpoint.h); the
+// same size and options always give the same matrix.
+//
+extern "C" const char* WorkInstance()
+{
+  return Instance.c_str();
+}
+
+
+//
+// WorkCredit: counts cell item (= row*cols + col) as solved by an earlier
+// run, which was checkpointed and is now being resumed.
+//
+extern "C" void WorkCredit(long item)
+{
+  if (item < 0 || item >= (long) NumRows * NumCols)
+  {
+    cout << "**Error in WorkCredit(): cell is out of bounds" << endl;
+    OutOfBounds = true;
+    return;
+  }
+
+  Executed[item].fetch_add(1, memory_order_relaxed);
+}
@@ -0,0 +1,164 @@
+/* freivalds.h */
+
+//
+// Randomized verification of a matrix multiply, after Freivalds: if
+// C == A * B then C x == A (B x) for every vector x, and if C is wrong
+// anywhere, a random x exposes it with probability ~1. Each check is 3
+// matrix-vector products, O(N^2) instead of the O(N^3) of recomputing C,
+// so every element of C is checked for a few percent of the multiply.
+//
+// All the random vectors are checked in the same pass over A, B and C, so
+// each matrix is read twice in all (once more for the error bound, below).
+// Rows are divided among the threads, and each dot product is a SIMD
+// reduction.
+//
+// C is only equal to A * B up to rounding, so row i is allowed an error of
+//
+//     rel * sum_k |A[i][k]| * sum_j |B[k][j]|
+//
+// which bounds the rounding error of C x if each element of C has relative
+// error rel (plus the rounding of the check itself, in double).
+//
+// Builds with or without OpenMP; without it, threads are std::threads.
+//
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#define FREIVALDS_SIMD_SUM _Pragma("omp simd reduction(+:sum)")
+#else
+#define FREIVALDS_SIMD_SUM
+#endif
+
+class Freivalds {
+    public:
+
+      //
+      // Check: checks C == A * B, where A is MxK, B is KxN and C is MxN,
+      // with trials random vectors and T threads, allowing C a relative
+      // error of rel per element. Returns true if C passes; worst is set to
+      // the largest error found, as a fraction of what's allowed (so a
+      // failure is worst > 1).
+      //
+      template <class E, class Accum>
+      static bool Check(E** const A, E** const B, Accum** const C, int M, int K, int N,
+                        int T, int trials, double rel, double& worst)
+      {
+        std::vector<double> x((size_t) trials * N);   // x[t*N + j], random in [-1, 1)
+        std::vector<double> y((size_t) trials * K);   // B x, one per trial
+        std::vector<double> ones(N, 1.0);
+        std::vector<double> absB(K);                  // |B| * [1 1 ... 1]
+        std::vector<double> bound(M);                 // |A| * |B| * [1 1 ... 1]
+        std::vector<double> error(M);                 // worst |A(Bx) - Cx| / bound, per row
+
+        std::mt19937 generator(std::random_device{}());
+        std::uniform_real_distribution<double> distribute(-1.0, 1.0);
+
+        for (double& v : x)
+          v = distribute(generator);
+
+        //
+        // since |x| <= 1, the rounding in row i is at most proportional to
+        // row i of |A| |B| 1, which we compute once for all the trials:
+        //
+        ParallelRows(K, T, [&](int k) {
+          absB[k] = Dot(B[k], ones.data(), N, true);
+        });
+
+        ParallelRows(M, T, [&](int i) {
+          bound[i] = Dot(A[i], absB.data(), K, true);
+        });
+
+        //
+        // y = B x, then row i of A y and of C x, for every trial:
+        //
+        ParallelRows(K, T, [&](int k) {
+          for (int t = 0; t < trials; t++)
+            y[(size_t) t * K + k] = Dot(B[k], &x[(size_t) t * N], N, false);
+        });
+
+        const double eps = std::numeric_limits<double>::epsilon();
+        const double allowed = rel + 2.0 * (K + N) * eps;
+
+        ParallelRows(M, T, [&](int i) {
+          double e = 0.0;
+
+          for (int t = 0; t < trials; t++)
+          {
+            double ABx = Dot(A[i], &y[(size_t) t * K], K, false);
+            double Cx  = Dot(C[i], &x[(size_t) t * N], N, false);
+
+            e = std::max(e, std::fabs(ABx - Cx) / (allowed * bound[i] + 0.0000001));
+          }
+
+          error[i] = e;
+        });
+
+        worst = (M > 0) ? *std::max_element(error.begin(), error.end()) : 0.0;
+        return !(worst > 1.0);  // NaN fails too
+      }
+
+    private:
+
+      //
+      // Dot: row . v over n elements, or |row| . v if absolute:
+      //
+      template <class E>
+      static double Dot(const E* row, const double* v, int n, bool absolute)
+      {
+        double sum = 0.0;
+
+        if (absolute)
+        {
+          FREIVALDS_SIMD_SUM
+          for (int j = 0; j < n; j++)
+            sum += std::fabs((double) row[j]) * v[j];
+        }
+        else
+        {
+          FREIVALDS_SIMD_SUM
+          for (int j = 0; j < n; j++)
+            sum += (double) row[j] * v[j];
+        }
+
+        return sum;
+      }
+
+      //
+      // ParallelRows: calls body(i) for 0 <= i < rows, with the rows split
+      // into T contiguous blocks, one per thread:
+      //
+      template <class Body>
+      static void ParallelRows(int rows, int T, Body body)
+      {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) num_threads(T)
+        for (int i = 0; i < rows; i++)
+          body(i);
+#else
+        std::vector<std::thread> threads;
+
+        for (int id = 0; id < T; id++)
+        {
+          int start = (int) ((long) rows * id / T);
+          int end = (int) ((long) rows * (id + 1) / T);
+
+          threads.push_back(std::thread([=]() {
+            for (int i = start; i < end; i++)
+              body(i);
+          }));
+        }
+
+        for (std::thread& t : threads)
+          t.join();
+#endif
+      }
+};
@@ -10,6 +10,7 @@
 
 #include "alloc2D.h"
 #include "mm.h"
+#include "numareport.h"
 
 using namespace std;
 
@@ -18,43 +19,64 @@ using namespace std;
 // MatrixMultiply:
 //
 // Computes and returns C = A * B, where matrices are NxN. No attempt is made
-// to optimize the multiplication.
+// to optimize the multiplication. The products are summed in (and C holds)
+// MMTraits<E>::Accum. rowNode[i] is set to the NUMA node of the thread that
+// computed row i, for NumaReport.
 //
-double** MatrixMultiply(double** const A, double** const B, int N, int T)
+template <class E>
+typename MMTraits<E>::Accum** MatrixMultiply(E** const A, E** const B, int N, int T, int* rowNode)
 {
-  double** C = New2dMatrix<double>(N, N);
+  typedef typename MMTraits<E>::Accum Accum;
+
+  Accum** C = New2dMatrix<Accum>(N, N);
 
   //
   // Setup:
   //
   cout << "Num cores: " << get_nprocs() << endl;
   cout << "Num threads: " << T << endl;
+  cout << "Element type: " << MMTraits<E>::Name() << endl;
   cout << endl;
 
-  //
-  // Initialize target matrix in prep for summing:
-  //
-  for (int i = 0; i < N; i++)
-    for (int j = 0; j < N; j++)
-      C[i][j] = 0.0;
-
   //
   // For every row i of A and column j of B:
   //
-  #pragma omp parallel for num_threads(T)
-  for (int i = 0; i < N; i++)
+  // NOTE: each row of C is initialized (in prep for summing) by the thread
+  // that computes it, not in a separate serial pass --- the first write to a
+  // page decides which NUMA node it lives on.
+  //
+  #pragma omp parallel num_threads(T)
   {
-    for (int j = 0; j < N; j++)
+    int node = NumaCurrentNode();
+
+    #pragma omp for schedule(static)
+    for (int i = 0; i < N; i++)
     {
-      for (int k = 0; k < N; k++)
+      for (int j = 0; j < N; j++)
+        C[i][j] = 0.0;
+
+      rowNode[i] = node;
+
+      for (int j = 0; j < N; j++)
       {
-        C[i][j] += (A[i][k] * B[k][j]);
+        for (int k = 0; k < N; k++)
+        {
+          C[i][j] += ((Accum) A[i][k] * (Accum) B[k][j]);
+        }
       }
     }
   }
-  
+
   //
   // return pointer to result matrix:
   //
   return C;
 }
+
+
+//
+// the element types we support:
+//
+template double** MatrixMultiply<double>(double** const A, double** const B, int N, int T, int* rowNode);
+template double** MatrixMultiply<float>(float** const A, float** const B, int N, int T, int* rowNode);
+template float**  MatrixMultiply<bfloat16>(bfloat16** const A, bfloat16** const B, int N, int T, int* rowNode);
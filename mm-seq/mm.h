@@ -4,4 +4,44 @@
 // Matrix Multiplication header file
 //
 
-double** MatrixMultiply(double** const A, double** const B, int N, int T);
+#pragma once
+
+#include <limits>
+
+#include "bfloat16.h"
+
+//
+// MMTraits: for each supported element (storage) type, the type used to
+// accumulate the dot products --- and hence the element type of C --- and
+// the relative error we tolerate when checking results. Summing N products
+// in type Accum can lose up to ~N ulps, so the tolerance scales with N.
+//
+template <class E> struct MMTraits;
+
+template <> struct MMTraits<double> {
+  typedef double Accum;
+  static const char* Name() { return "double"; }
+  static double Tolerance(int N) { return N * std::numeric_limits<Accum>::epsilon(); }
+};
+
+template <> struct MMTraits<float> {
+  typedef double Accum;
+  static const char* Name() { return "float"; }
+  static double Tolerance(int N) { return N * std::numeric_limits<Accum>::epsilon(); }
+};
+
+template <> struct MMTraits<bfloat16> {
+  typedef float Accum;
+  static const char* Name() { return "bf16"; }
+  static double Tolerance(int N) { return N * std::numeric_limits<Accum>::epsilon(); }
+};
+
+//
+// C = A * B, where A and B are NxN matrices of element type E. C is
+// allocated by the call, with element type MMTraits<E>::Accum.
+// rowNode (N ints, provided by the caller) is filled with the NUMA node of
+// the thread that computed each row of C, for NumaReport (see numareport.h),
+// which the caller runs after its timed region since the query isn't free.
+//
+template <class E>
+typename MMTraits<E>::Accum** MatrixMultiply(E** const A, E** const B, int N, int T, int* rowNode);
@@ -0,0 +1,262 @@
+/*affinity.h*/
+
+//
+// Thread placement, selected with -bind:
+//
+//   none      leave it to the OS (the default)
+//   compact   thread t on the t-th CPU in topology order (see topology.h),
+//             filling SMT siblings, then cores, complexes and nodes in turn
+//   cores     one thread per physical core first; SMT siblings are only
+//             used once every core has a thread
+//   spread    round-robin across core complexes, alternating nodes, one
+//             thread per core within a complex before doubling up
+//   list:L    thread t on the t-th CPU of the list L, e.g. list:0,2,4-7
+//
+// With more threads than CPUs, the placement wraps around. Threads bind
+// themselves: OpenMP drivers call BindOpenMP once up front, which pins the
+// threads of the OpenMP thread pool (OpenMP reuses them for later parallel
+// regions of up to that many threads); pthreads call Pin with their own id.
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sched.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "topology.h"
+
+class Affinity {
+    public:
+
+      //
+      // SetPolicy: parses the -bind argument, returns false if unknown:
+      //
+      static bool SetPolicy(const std::string& policy)
+      {
+        State& s = state();
+        const Topology& topo = s.topo;
+        std::vector<int> order;
+
+        if (policy == "none")
+          ;
+        else if (policy == "compact")
+        {
+          for (int i = 0; i < topo.num_cpus(); i++)
+            order.push_back(i);
+        }
+        else if (policy == "cores")
+          order = ByCore(topo, 0, topo.num_cpus());
+        else if (policy == "spread")
+          order = Spread(topo);
+        else if (policy.compare(0, 5, "list:") == 0)
+        {
+          if (!ByList(topo, policy.substr(5), order))
+            return false;
+        }
+        else
+          return false;
+
+        s.policy = policy;
+        s.order = order;
+        return true;
+      }
+
+      static std::string Policy() { return state().policy; }
+
+      static const Topology& Topo() { return state().topo; }
+
+      //
+      // Position: where thread tid goes, as a position in Topo(), or -1 if
+      // threads aren't bound:
+      //
+      static int Position(int tid)
+      {
+        const std::vector<int>& order = state().order;
+        return order.empty() ? -1 : order[tid % order.size()];
+      }
+
+      //
+      // Pin: binds the calling thread as thread tid; returns false if not
+      // bound (policy none, or the kernel refused):
+      //
+      static bool Pin(int tid)
+      {
+        int pos = Position(tid);
+        return (pos >= 0) && state().topo.pin(pos);
+      }
+
+      //
+      // BindOpenMP: pins each thread of a team of T threads:
+      //
+      static void BindOpenMP(int T)
+      {
+#ifdef _OPENMP
+        if (Position(0) < 0)
+          return;
+
+        int failed = 0;
+
+        #pragma omp parallel num_threads(T) reduction(+:failed)
+        {
+          if (!Pin(omp_get_thread_num()))
+            failed++;
+        }
+
+        if (failed > 0)
+          std::cout << "**WARNING: " << failed << " thread(s) could not be bound" << std::endl;
+#endif
+      }
+
+      //
+      // Report: prints the thread-to-CPU map for T threads, e.g.
+      //
+      //   Bind:         spread (2 nodes, 32 cpus)
+      //   Thread->CPU:  0->0 1->16 2->4 3->20
+      //
+      static void Report(int T)
+      {
+        const Topology& topo = state().topo;
+
+        std::cout << "Bind:         " << Policy() << " (" << topo.num_nodes()
+                  << " node(s), " << topo.num_cpus() << " cpu(s))" << std::endl;
+
+        if (Position(0) < 0)
+          return;
+
+        std::cout << "Thread->CPU: ";
+        for (int t = 0; t < T; t++)
+          std::cout << " " << t << "->" << topo.cpu(Position(t));
+        std::cout << std::endl;
+      }
+
+    private:
+
+      struct State {
+        Topology         topo;
+        std::string      policy = "none";
+        std::vector<int> order;  // thread t => position order[t % size]
+      };
+
+      static State& state()
+      {
+        static State s;
+        return s;
+      }
+
+      //
+      // ByCore: positions first..last-1 with the first CPU of every core
+      // before any second SMT sibling, and so on:
+      //
+      static std::vector<int> ByCore(const Topology& topo, int first, int last)
+      {
+        std::vector<int> order;
+
+        for (int rank = 0; (int) order.size() < last - first; rank++)
+        {
+          for (int i = first; i < last; i++)
+          {
+            int sibling = 0;  // i is the sibling-th CPU of its core
+            for (int j = i - 1; j >= first && topo.core(j) == topo.core(i); j--)
+              sibling++;
+
+            if (sibling == rank)
+              order.push_back(i);
+          }
+        }
+
+        return order;
+      }
+
+      //
+      // Spread: each complex's CPUs in ByCore order, dealt out round-robin
+      // over the complexes, which are ordered so consecutive ones are on
+      // different nodes:
+      //
+      static std::vector<int> Spread(const Topology& topo)
+      {
+        struct Complex {
+          int node;
+          int rank;  // rank among the node's complexes
+          std::vector<int> cpus;
+        };
+
+        std::vector<Complex> complexes;
+
+        for (int i = 0; i < topo.num_cpus(); )
+        {
+          int j = i;
+          while (j < topo.num_cpus() && topo.complex(j) == topo.complex(i))
+            j++;
+
+          int rank = 0;
+          for (const Complex& c : complexes)
+            if (c.node == topo.node(i))
+              rank++;
+
+          complexes.push_back(Complex{ topo.node(i), rank, ByCore(topo, i, j) });
+          i = j;
+        }
+
+        std::stable_sort(complexes.begin(), complexes.end(),
+          [](const Complex& a, const Complex& b) { return a.rank < b.rank; });
+
+        std::vector<int> order;
+
+        for (size_t k = 0; (int) order.size() < topo.num_cpus(); k++)
+          for (const Complex& c : complexes)
+            if (k < c.cpus.size())
+              order.push_back(c.cpus[k]);
+
+        return order;
+      }
+
+      //
+      // ByList: positions of the CPUs in list (e.g. "0,2,4-7"), in list
+      // order; returns false if the list is empty or names a CPU we can't
+      // run on:
+      //
+      static bool ByList(const Topology& topo, const std::string& list, std::vector<int>& order)
+      {
+        for (size_t start = 0; start <= list.size(); )
+        {
+          size_t comma = list.find(',', start);
+          if (comma == std::string::npos)
+            comma = list.size();
+
+          std::string range = list.substr(start, comma - start);
+          size_t dash = range.find('-');
+          int lo = atoi(range.c_str());
+          int hi = (dash == std::string::npos) ? lo : atoi(range.c_str() + dash + 1);
+
+          if (range.empty() || hi < lo)
+            return false;
+
+          for (int cpu = lo; cpu <= hi; cpu++)
+          {
+            int pos = -1;
+            for (int i = 0; i < topo.num_cpus(); i++)
+              if (topo.cpu(i) == cpu)
+                pos = i;
+
+            if (pos < 0)
+            {
+              std::cout << "**ERROR: cpu " << cpu << " is not available" << std::endl;
+              return false;
+            }
+
+            order.push_back(pos);
+          }
+
+          start = comma + 1;
+        }
+
+        return !order.empty();
+      }
+};
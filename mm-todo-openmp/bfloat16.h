@@ -0,0 +1,46 @@
+/* bfloat16.h */
+
+//
+// bfloat16 storage type: the upper 16 bits of an IEEE float (1 sign bit,
+// 8 exponent bits, 7 mantissa bits). Same range as float, but only ~3
+// significant digits, so it is used for storage only --- arithmetic is
+// always done after widening to float (or double).
+//
+// Widening is a 16-bit shift, which the compiler can vectorize inside
+// an "omp simd" loop.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+struct bfloat16 {
+  uint16_t bits;
+
+  bfloat16() = default;
+
+  //
+  // narrow from float, rounding to nearest even:
+  //
+  bfloat16(float f)
+  {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+
+    u += 0x7FFF + ((u >> 16) & 1);
+    bits = (uint16_t) (u >> 16);
+  }
+
+  //
+  // widen to float, exact:
+  //
+  operator float() const
+  {
+    uint32_t u = ((uint32_t) bits) << 16;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+
+    return f;
+  }
+};
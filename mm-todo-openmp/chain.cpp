@@ -0,0 +1,238 @@
+/* chain.cpp */
+
+//
+// Matrix chain and matrix power implementation. See chain.h.
+//
+#include <iostream>
+#include <string>
+#include <cstring>
+
+#include "alloc2D.h"
+#include "mm.h"
+#include "chain.h"
+
+using namespace std;
+
+
+//
+// MMWorkspace:
+//
+MMWorkspace::MMWorkspace()
+  : allocations(0)
+{ }
+
+MMWorkspace::~MMWorkspace()
+{
+  for (Buffer& b : buffers)
+    Delete2dMatrix(b.M);
+}
+
+//
+// Acquire: best fit among the free matrices, so a smaller request doesn't
+// tie up a large matrix that a later request may need.
+//
+double** MMWorkspace::Acquire(int ROWS, int COLS)
+{
+  long   needed = (long) ROWS * COLS;
+  Buffer* best = nullptr;
+
+  for (Buffer& b : buffers)
+  {
+    if (b.InUse || b.RowCapacity < ROWS || b.Capacity < needed)
+      continue;
+    if (best == nullptr || b.Capacity < best->Capacity)
+      best = &b;
+  }
+
+  if (best == nullptr)
+  {
+    Buffer b;
+    b.M = New2dMatrix<double>(ROWS, COLS);
+    b.RowCapacity = ROWS;
+    b.Capacity = needed;
+    b.InUse = false;
+
+    buffers.push_back(b);
+    allocations++;
+
+    best = &buffers.back();
+  }
+
+  //
+  // the elements are one contiguous block starting at M[0], so the rows
+  // can be re-pointed for this shape:
+  //
+  double** M = best->M;
+  for (int r = 1; r < ROWS; r++)
+    M[r] = &M[0][(long) r * COLS];
+
+  best->InUse = true;
+
+  return M;
+}
+
+void MMWorkspace::Release(double** M)
+{
+  for (Buffer& b : buffers)
+    if (b.M == M)
+      b.InUse = false;
+}
+
+
+//
+// CopyMatrix: D = S, both ROWSxCOLS.
+//
+static void CopyMatrix(double** const S, double** D, int ROWS, int COLS, int T)
+{
+  #pragma omp parallel for num_threads(T)
+  for (int r = 0; r < ROWS; r++)
+    memcpy(D[r], S[r], COLS * sizeof(double));
+}
+
+
+//
+// MatrixChainOrder:
+//
+// The classic O(n^3) dynamic program: cost[i][j] is the cheapest way to
+// multiply matrices i..j, trying every split point s.
+//
+double MatrixChainOrder(const int* dims, int n, vector<double> &cost, vector<int> &split)
+{
+  cost.assign((size_t) n * n, 0.0);
+  split.assign((size_t) n * n, 0);
+
+  for (int len = 2; len <= n; len++)
+  {
+    for (int i = 0; i + len - 1 < n; i++)
+    {
+      int j = i + len - 1;
+      double best = -1.0;
+
+      for (int s = i; s < j; s++)
+      {
+        double c = cost[i*n + s] + cost[(s+1)*n + j] +
+                   (double) dims[i] * dims[s+1] * dims[j+1];
+
+        if (best < 0.0 || c < best)
+        {
+          best = c;
+          split[i*n + j] = s;
+        }
+      }
+
+      cost[i*n + j] = best;
+    }
+  }
+
+  return cost[n - 1];  // i.e. cost[0][n-1]
+}
+
+
+//
+// ChainProduct: D = mats[i] * ... * mats[j], following the split table.
+// Sub-products that are not a single input matrix go into workspace
+// matrices, which are released as soon as they have been consumed.
+//
+static void ChainProduct(double** const* mats, const int* dims, int n, int i, int j,
+                         double** D, int T, MMWorkspace &W)
+{
+  int s = W.Split[i*n + j];
+
+  double** L = mats[i];
+  if (s > i)
+  {
+    L = W.Acquire(dims[i], dims[s+1]);
+    ChainProduct(mats, dims, n, i, s, L, T, W);
+  }
+
+  double** R = mats[j];
+  if (s + 1 < j)
+  {
+    R = W.Acquire(dims[s+1], dims[j+1]);
+    ChainProduct(mats, dims, n, s + 1, j, R, T, W);
+  }
+
+  MatrixMultiply(L, R, D, dims[i], dims[s+1], dims[j+1], T, W);
+
+  if (L != mats[i])
+    W.Release(L);
+  if (R != mats[j])
+    W.Release(R);
+}
+
+
+//
+// MatrixChainMultiply:
+//
+void MatrixChainMultiply(double** const* mats, const int* dims, int n, double** D, int T, MMWorkspace &W)
+{
+  if (n == 1)
+  {
+    CopyMatrix(mats[0], D, dims[0], dims[1], T);
+    return;
+  }
+
+  MatrixChainOrder(dims, n, W.Cost, W.Split);
+
+  ChainProduct(mats, dims, n, 0, n - 1, D, T, W);
+}
+
+
+//
+// MatrixPower:
+//
+// Square-and-multiply over the bits of k, low to high. The successive
+// squares A, A^2, A^4, ... ping-pong between two workspace matrices, as
+// does the running product, so only 4 scratch matrices are ever needed.
+//
+void MatrixPower(double** const A, int k, double** D, int N, int T, MMWorkspace &W)
+{
+  if (k == 0)  // identity:
+  {
+    #pragma omp parallel for num_threads(T)
+    for (int r = 0; r < N; r++)
+      for (int c = 0; c < N; c++)
+        D[r][c] = (r == c) ? 1.0 : 0.0;
+    return;
+  }
+
+  double** squares[2]  = { W.Acquire(N, N), W.Acquire(N, N) };
+  double** products[2] = { W.Acquire(N, N), W.Acquire(N, N) };
+
+  double** base = A;         // A^(2^bit)
+  double** product = nullptr;
+  int s = 0, p = 0;
+
+  while (true)
+  {
+    if (k & 1)
+    {
+      if (product == nullptr)  // first factor:
+      {
+        CopyMatrix(base, products[p], N, N, T);
+      }
+      else
+      {
+        MatrixMultiply(product, base, products[1 - p], N, N, N, T, W);
+        p = 1 - p;
+      }
+
+      product = products[p];
+    }
+
+    k >>= 1;
+    if (k == 0)
+      break;
+
+    MatrixMultiply(base, base, squares[s], N, N, N, T, W);
+    base = squares[s];
+    s = 1 - s;
+  }
+
+  CopyMatrix(product, D, N, N, T);
+
+  W.Release(squares[0]);
+  W.Release(squares[1]);
+  W.Release(products[0]);
+  W.Release(products[1]);
+}
@@ -0,0 +1,69 @@
+/* chain.h */
+
+//
+// Matrix chain and matrix power header file. Both are built on the
+// MatrixMultiply overloads in mm.h that write into a caller-provided C,
+// with intermediate results (and the scratch of the multiplies themselves)
+// kept in an MMWorkspace so that repeated calls allocate nothing after the
+// first (warmup) call.
+//
+
+#pragma once
+
+#include <vector>
+
+//
+// MMWorkspace: a pool of scratch matrices. Acquire hands out a free
+// matrix with room for at least ROWSxCOLS elements (allocating one only
+// if none is free), re-pointing its rows for the requested shape; Release
+// returns it to the pool. Matrices are freed when the workspace is.
+//
+class MMWorkspace {
+    public:
+
+      MMWorkspace();
+      ~MMWorkspace();
+
+      double** Acquire(int ROWS, int COLS);
+      void     Release(double** M);
+
+      // total # of matrices allocated over the workspace's lifetime:
+      long Allocations() const { return allocations; }
+
+      // scratch tables for MatrixChainMultiply, reused across calls:
+      std::vector<double> Cost;
+      std::vector<int>    Split;
+
+    private:
+
+      struct Buffer {
+        double** M;
+        int      RowCapacity;
+        long     Capacity;
+        bool     InUse;
+      };
+
+      std::vector<Buffer> buffers;
+      long allocations;
+};
+
+//
+// MatrixChainOrder: given n matrices where matrix i is dims[i] x dims[i+1],
+// finds the parenthesization that minimizes the # of multiply-adds, and
+// returns that #. split[i*n + j] is where the product of matrices i..j is
+// split, i.e. (i..s) * (s+1..j).
+//
+double MatrixChainOrder(const int* dims, int n, std::vector<double> &cost, std::vector<int> &split);
+
+//
+// MatrixChainMultiply: D = mats[0] * mats[1] * ... * mats[n-1], where
+// mats[i] is dims[i] x dims[i+1] and D (provided by the caller) is
+// dims[0] x dims[n]. Uses the parenthesization from MatrixChainOrder.
+//
+void MatrixChainMultiply(double** const* mats, const int* dims, int n, double** D, int T, MMWorkspace &W);
+
+//
+// MatrixPower: D = A^k, where A and D (provided by the caller) are NxN
+// and k >= 0, by repeated squaring.
+//
+void MatrixPower(double** const A, int k, double** D, int N, int T, MMWorkspace &W);
@@ -3,11 +3,35 @@
 //
 // Naive Matrix Multiplication app
 //
-// Uses standard triply-nested loop, nothing special. For simplicity, the matrices 
-// are always square, i.e. we multiply NxN matrices, producing an NxN matrix.
+// Uses standard triply-nested loop, nothing special. By default the matrices
+// are square, i.e. we multiply NxN matrices, producing an NxN matrix. With
+// -m M and/or -k K, we multiply an MxK matrix by a KxN matrix, producing an
+// MxN matrix.
+//
+// With -p float or -p bf16, A and B are stored in reduced precision (and
+// accumulated in double or float, respectively); the multiply is then
+// repeated in double to report the speedup.
+//
+// With -density D < 1, each element of A is non-zero with probability D,
+// and the dense multiply is compared with sparse multiplies of the same A,
+// in CSR and in CSC form.
+//
+// With -tiled, the multiply is repeated on tiled (Morton order) copies of
+// A and B, see tiled.h, to compare.
+//
+// Results are checked at the corners of C; with -verify, every element of
+// C is also checked, by Freivalds' randomized test (see freivalds.h).
+//
+// With -power K, computes A^K; with -chain d0,d1,...,dn, multiplies a chain
+// of n matrices where matrix i is d(i) x d(i+1), in the cheapest order.
+// Both reuse scratch matrices across calls (see chain.h), and report the
+// time of a second, allocation-free call.
 //
 // Usage:
-//   mm [-?] [-n MatrixSize] [-t NumThreads]
+//   mm [-?] [-n MatrixSize] [-m Rows] [-k Inner] [-t NumThreads]
+//      [-p double|float|bf16] [-density D] [-power K] [-chain d0,d1,...,dn]
+//      [-bind compact|spread|cores|list:CPUS|none] [-perf]
+//      [-partition auto|rows|cols|inner|recursive] [-tiled] [-verify]
 //
 // Author:
 //   Prof. Joe Hummel
@@ -19,10 +43,18 @@
 #include <cmath>
 #include <cstring>
 #include <chrono>
+#include <random>
+#include <vector>
+#include <sstream>
 #include <sys/sysinfo.h>
 
 #include "alloc2D.h"
 #include "mm.h"
+#include "affinity.h"
+#include "chain.h"
+#include "perfcounters.h"
+#include "freivalds.h"
+#include "numareport.h"
 
 using namespace std;
 
@@ -30,14 +62,30 @@ using namespace std;
 //
 // Globals:
 //
-static int _matrixSize;
-static int _numThreads;
+static int    _matrixSize;
+static int    _rows;   // M, defaults to _matrixSize
+static int    _inner;  // K, defaults to _matrixSize
+static int    _numThreads;
+static string _elemType;
+static double _density;
+static int    _power;
+static vector<int> _chainDims;
+static bool   _perf;  // hardware counters around the multiply?
+static bool   _tiled;  // also multiply in tiled (Morton) form?
+static bool   _verify;  // check all of C, not just the corners?
 
 //
 // Function prototypes:
 //
-void CreateAndFillMatrices(int N, double** &A, double** &B, double &TL, double &TR, double &BL, double &BR);
-void CheckResults(int N, double** C, double TL, double TR, double BL, double BR);
+template <class E> double RunMultiply(int M, int K, int N, int T);
+void RunSparse(int N, int T, double density);
+void RunTiled(int M, int K, int N, int T);
+void RunPower(int N, int T, int k);
+void RunChain(const vector<int> &dims, int T);
+template <class E> void CreateAndFillMatrices(int M, int K, int N, E** &A, E** &B, double &TL, double &TR, double &BL, double &BR);
+template <class E> void CheckResults(int M, int K, int N, typename MMTraits<E>::Accum** C, double TL, double TR, double BL, double BR);
+template <class E> void Verify(E** const A, E** const B, typename MMTraits<E>::Accum** C, int M, int K, int N, int T, double multiplySecs);
+template <class Accum> void CheckCorners(Accum** C, int ROWS, int COLS, double TL, double TR, double BL, double BR, double rel);
 void ProcessCmdLineArgs(int argc, char* argv[]);
 
 
@@ -50,57 +98,580 @@ int main(int argc, char *argv[])
 	// Set defaults, process environment & cmd-line args:
 	//
 	_matrixSize = 2000;
+	_rows       = 0;    // i.e. square
+	_inner      = 0;
 	_numThreads = 1;  // sequential execution
+	_elemType   = "double";
+	_density    = 1.0;  // dense
+	_power      = 0;    // not computing a power
+	_perf       = false;
+	_tiled      = false;
+	_verify     = false;
 
 	ProcessCmdLineArgs(argc, argv);
 
+	if (_rows == 0)
+		_rows = _matrixSize;
+	if (_inner == 0)
+		_inner = _matrixSize;
+
+	bool square = (_rows == _matrixSize && _inner == _matrixSize);
+
 	cout << "** Matrix Multiply Application **" << endl;
     cout << endl;
-	cout << "Matrix size: " << _matrixSize << "x" << _matrixSize << endl;
+	Affinity::Report(_numThreads);
+	Affinity::BindOpenMP(_numThreads);
+
+	//
+	// Matrix chain? Dimensions come from -chain, not -n:
+	//
+	if (!_chainDims.empty())
+	{
+		RunChain(_chainDims, _numThreads);
+
+		cout << "** Execution complete **" << endl;
+		cout << endl;
+		return 0;
+	}
+
+	if (square)
+		cout << "Matrix size: " << _matrixSize << "x" << _matrixSize << endl;
+	else
+		cout << "Matrix sizes: " << _rows << "x" << _inner << " * " << _inner << "x" << _matrixSize << endl;
+
+	if (!square && (_power > 0 || _density < 1.0))
+	{
+		cout << "**-power and -density require square matrices" << endl << endl;
+		exit(0);
+	}
 
+	//
+	// Matrix power?
+	//
+	if (_power > 0)
+	{
+		RunPower(_matrixSize, _numThreads, _power);
+
+		cout << "** Execution complete **" << endl;
+		cout << endl;
+		return 0;
+	}
+
+	//
+	// Sparse A? Then compare dense vs. sparse multiply of the same A (the
+	// sparse kernels are double only):
+	//
+	if (_density < 1.0)
+	{
+		if (_elemType != "double")
+		{
+			cout << "**-density requires -p double" << endl << endl;
+			exit(0);
+		}
+
+		RunSparse(_matrixSize, _numThreads, _density);
+
+		cout << "** Execution complete **" << endl;
+		cout << endl;
+		return 0;
+	}
+
+	//
+	// Tiled? Then compare the row-major multiply with the tiled one (the
+	// tiled kernel is double only):
+	//
+	if (_tiled)
+	{
+		if (_elemType != "double")
+		{
+			cout << "**-tiled requires -p double" << endl << endl;
+			exit(0);
+		}
+
+		RunTiled(_rows, _inner, _matrixSize, _numThreads);
+
+		cout << "** Execution complete **" << endl;
+		cout << endl;
+		return 0;
+	}
+
+	//
+	// Multiply using the requested element type:
+	//
+	double secs;
+
+	if (_elemType == "float")
+		secs = RunMultiply<float>(_rows, _inner, _matrixSize, _numThreads);
+	else if (_elemType == "bf16")
+		secs = RunMultiply<bfloat16>(_rows, _inner, _matrixSize, _numThreads);
+	else
+		secs = RunMultiply<double>(_rows, _inner, _matrixSize, _numThreads);
+
+    cout << endl;
+    cout << "** Done!  Time: " << secs << " secs" << endl;
+
+	//
+	// for reduced precision, repeat in double so we can report the speedup:
+	//
+	if (_elemType != "double")
+	{
+		cout << endl;
+		cout << "** Baseline (double) run **" << endl;
+
+		double base = RunMultiply<double>(_rows, _inner, _matrixSize, _numThreads);
+
+		cout << endl;
+		cout << "** Baseline time: " << base << " secs" << endl;
+		if (secs > 0.0)
+			cout << "** Speedup vs double: " << base / secs << "x" << endl;
+	}
+
+	cout << "** Execution complete **" << endl;
+    cout << endl;
+
+	return 0;
+}
+
+
+//
+// RunMultiply:
+//
+// Creates A (MxK) and B (KxN) with elements of type E, multiplies, checks
+// the results, and returns the time of the multiply (in secs).
+//
+template <class E> double RunMultiply(int M, int K, int N, int T)
+{
 	//
 	// Create and fill the matrices to multiply:
 	//
-	double **A, **B, TL, TR, BL, BR;
-	CreateAndFillMatrices(_matrixSize, A, B, TL, TR, BL, BR);
+	E **A, **B;
+	double TL, TR, BL, BR;
+	CreateAndFillMatrices(M, K, N, A, B, TL, TR, BL, BR);
+
+	//
+	// What the multiply moves, at the least: A and B in the element type, C
+	// in the (possibly wider) accumulation type:
+	//
+	double abBytes = sizeof(E) * ((double) M * K + (double) K * N);
+	double cBytes = sizeof(typename MMTraits<E>::Accum) * (double) M * N;
+
+	cout << "Bytes: A+B " << abBytes / 1e6 << " MB (" << sizeof(E) << " per element), C "
+	     << cBytes / 1e6 << " MB (" << sizeof(typename MMTraits<E>::Accum) << " per element)" << endl;
+
+	//
+	// With -perf, measure the roofline ceilings and open the counters before
+	// starting the clock:
+	//
+	double peakGflops = 0.0, peakGBs = 0.0;
+	PerfCounters* counters = nullptr;
+
+	if (_perf)
+	{
+		PerfCounters::MeasureCeilings(T, peakGflops, peakGBs);
+		counters = new PerfCounters(T);
+		counters->start();
+	}
+
+	int* rowNode = new int[M];  // see MatrixMultiply
 
 	//
 	// Start clock and multiply:
 	//
     auto start = chrono::high_resolution_clock::now();
 
-	double** C = MatrixMultiply(A, B, _matrixSize, _numThreads);
+	typename MMTraits<E>::Accum** C = MatrixMultiply(A, B, M, K, N, T, rowNode);
   
     auto stop = chrono::high_resolution_clock::now();
     auto diff = stop - start;
     auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
 
+	if (_perf)
+	{
+		counters->stop();
+
+		//
+		// 2 flops per multiply-add, and A, B and C each cross memory at least
+		// once:
+		//
+		double flops = 2.0 * M * K * N;
+
+		cout << endl;
+		counters->Report(chrono::duration<double>(diff).count(), flops, abBytes + cBytes, peakGflops, peakGBs);
+		delete counters;
+	}
+
 	//
-	// Done, check results and output timing:
+	// Where did the rows of C end up? (The query isn't free, so it's done
+	// after the clock stops.)
 	//
-	CheckResults(_matrixSize, C, TL, TR, BL, BR);
+	NumaReport(C, M, (ChoosePartition(M, K, N, T) == MM_SPLIT_M) ? rowNode : nullptr);
+	cout << endl;
 
-    cout << endl;
-    cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
-	cout << "** Execution complete **" << endl;
-    cout << endl;
+	delete[] rowNode;
+
+	//
+	// Done, check results:
+	//
+	CheckResults<E>(M, K, N, C, TL, TR, BL, BR);
+
+	if (_verify)
+		Verify(A, B, C, M, K, N, T, chrono::duration<double>(diff).count());
 
 	Delete2dMatrix(A);
 	Delete2dMatrix(B);
 	Delete2dMatrix(C);
 
-	return 0;
+	return duration.count() / 1000.0;
+}
+
+
+//
+// RunSparse:
+//
+// Fills A like CreateAndFillMatrices does, except that each element is
+// non-zero with probability density. Then multiplies A*B three times,
+// densely with MatrixMultiply and sparsely with SparseMatrixMultiply on the
+// CSR and the CSC forms of A, checks all three, and reports the times. Also checks
+// SparseMatrixVectorMultiply, since A*[1 1 ... 1] yields the row sums of A.
+//
+void RunSparse(int N, int T, double density)
+{
+	double **A, **B, TL, TR, BL, BR;
+	CreateAndFillMatrices(N, N, N, A, B, TL, TR, BL, BR);
+
+	//
+	// knock out elements of A, keeping a count per row:
+	//
+	random_device rd;
+	mt19937 generator(rd());
+	bernoulli_distribution keep(density);
+
+	long* counts = new long[N];
+
+	for (int r = 0; r < N /*rows*/; r++)
+	{
+		counts[r] = 0;
+
+		for (int c = 0; c < N /*cols*/; c++)
+		{
+			if (keep(generator))
+				counts[r]++;
+			else
+				A[r][c] = 0.0;
+		}
+	}
+
+	//
+	// row i of A now sums to (i+1)*counts[i], and B's columns are constant,
+	// so C[i][j] == (i+1)*counts[i]*(j+1):
+	//
+	double dN = N;
+
+	TL = 1.0 * counts[0];
+	TR = 1.0 * counts[0] * dN;
+	BL = dN * counts[N-1];
+	BR = dN * counts[N-1] * dN;
+
+	//
+	// dense multiply:
+	//
+	auto start = chrono::high_resolution_clock::now();
+
+	double** C = MatrixMultiply(A, B, N, T);
+
+	auto stop = chrono::high_resolution_clock::now();
+	double denseSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	CheckResults<double>(N, N, N, C, TL, TR, BL, BR);
+	Delete2dMatrix(C);
+
+	//
+	// convert to CSR, then sparse multiply:
+	//
+	start = chrono::high_resolution_clock::now();
+
+	CSRMatrix<double>* S = NewCSRMatrix(A, N, N, T);
+
+	stop = chrono::high_resolution_clock::now();
+	double buildSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	start = chrono::high_resolution_clock::now();
+
+	C = SparseMatrixMultiply(S, B, N, T);
+
+	stop = chrono::high_resolution_clock::now();
+	double sparseSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	CheckResults<double>(N, N, N, C, TL, TR, BL, BR);
+
+	if (_verify)
+		Verify(A, B, C, N, N, N, T, sparseSecs);
+	Delete2dMatrix(C);
+
+	//
+	// convert to CSC, then sparse multiply again:
+	//
+	start = chrono::high_resolution_clock::now();
+
+	CSCMatrix<double>* SC = NewCSCMatrix(A, N, N, T);
+
+	stop = chrono::high_resolution_clock::now();
+	double cscBuildSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	start = chrono::high_resolution_clock::now();
+
+	C = SparseMatrixMultiply(SC, B, N, T);
+
+	stop = chrono::high_resolution_clock::now();
+	double cscSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	CheckResults<double>(N, N, N, C, TL, TR, BL, BR);
+	Delete2dMatrix(C);
+
+	//
+	// sparse matrix-vector:
+	//
+	double* x = new double[N];
+	double* y = new double[N];
+
+	for (int i = 0; i < N; i++)
+		x[i] = 1.0;
+
+	SparseMatrixVectorMultiply(S, x, y, T);
+
+	for (int i = 0; i < N; i++)
+	{
+		if (fabs(y[i] - (i + 1.0) * counts[i]) > 0.0000001)
+		{
+			cout << "** ERROR: sparse matrix-vector multiply yielded incorrect results" << endl << endl;
+			exit(0);
+		}
+	}
+
+	cout << "Density: " << density << " (" << S->NNZ << " non-zeros)" << endl;
+	cout << endl;
+	cout << "** Dense time:     " << denseSecs << " secs" << endl;
+	cout << "** CSR build time: " << buildSecs << " secs" << endl;
+	cout << "** Sparse time:    " << sparseSecs << " secs" << endl;
+	cout << "** CSC build time: " << cscBuildSecs << " secs" << endl;
+	cout << "** CSC time:       " << cscSecs << " secs" << endl;
+	if (sparseSecs > 0.0)
+		cout << "** Speedup of sparse vs dense: " << denseSecs / sparseSecs << "x" << endl;
+
+	delete[] x;
+	delete[] y;
+	delete[] counts;
+
+	DeleteCSRMatrix(S);
+	DeleteCSCMatrix(SC);
+	Delete2dMatrix(A);
+	Delete2dMatrix(B);
 }
 
 
 //
-// CreateAndFillMatrices:  fills A and B with predefined values, and then set TL, TR, BL and BR
-// to the expected top-left, top-right, bottom-left and bottom-right values after the multiply.
+// RunTiled:
 //
-void CreateAndFillMatrices(int N, double** &A, double** &B, double &TL, double &TR, double &BL, double &BR)
+// Multiplies A (MxK) by B (KxN) twice, row-major with MatrixMultiply and
+// tiled (see tiled.h), checks both, and reports both times. The conversions
+// to and from the tiled form are timed separately, since a program working
+// in tiled form throughout would only pay them once.
+//
+void RunTiled(int M, int K, int N, int T)
 {
-	A = New2dMatrix<double>(N, N);
-	B = New2dMatrix<double>(N, N);
+	double **A, **B, TL, TR, BL, BR;
+	CreateAndFillMatrices(M, K, N, A, B, TL, TR, BL, BR);
+
+	//
+	// row-major multiply:
+	//
+	auto start = chrono::high_resolution_clock::now();
+
+	double** C = MatrixMultiply(A, B, M, K, N, T);
+
+	auto stop = chrono::high_resolution_clock::now();
+	double denseSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	CheckResults<double>(M, K, N, C, TL, TR, BL, BR);
+
+	//
+	// convert to tiled, multiply, and convert C back (into the same C, so
+	// nothing left over from the row-major multiply can pass the check):
+	//
+	for (int i = 0; i < M; i++)
+		for (int j = 0; j < N; j++)
+			C[i][j] = 0.0;
+
+	start = chrono::high_resolution_clock::now();
+
+	TiledMatrix<double>* TA = ToTiled(A, M, K, T);
+	TiledMatrix<double>* TB = ToTiled(B, K, N, T);
+	TiledMatrix<double>* TC = NewTiledMatrix<double>(M, N, T);
+
+	stop = chrono::high_resolution_clock::now();
+	double toSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	start = chrono::high_resolution_clock::now();
+
+	MatrixMultiply(TA, TB, TC, T);
+
+	stop = chrono::high_resolution_clock::now();
+	double tiledSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	start = chrono::high_resolution_clock::now();
+
+	FromTiled(TC, C, T);
+
+	stop = chrono::high_resolution_clock::now();
+	double fromSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	CheckResults<double>(M, K, N, C, TL, TR, BL, BR);
+
+	if (_verify)
+		Verify(A, B, C, M, K, N, T, tiledSecs);
+
+	cout << "Tiles: " << TILE << "x" << TILE << ", " << TC->TileRows << "x" << TC->TileCols
+	     << " tiles of C in Morton order" << endl;
+	cout << endl;
+	cout << "** Row-major time:  " << denseSecs << " secs" << endl;
+	cout << "** To tiled time:   " << toSecs << " secs (A, B and C)" << endl;
+	cout << "** Tiled time:      " << tiledSecs << " secs" << endl;
+	cout << "** From tiled time: " << fromSecs << " secs" << endl;
+	if (tiledSecs > 0.0)
+		cout << "** Speedup of tiled vs row-major: " << denseSecs / tiledSecs << "x" << endl;
+
+	DeleteTiledMatrix(TA);
+	DeleteTiledMatrix(TB);
+	DeleteTiledMatrix(TC);
+	Delete2dMatrix(A);
+	Delete2dMatrix(B);
+	Delete2dMatrix(C);
+}
+
+
+//
+// RunPower:
+//
+// Computes A^k, where A is filled as in CreateAndFillMatrices. Every row of
+// A is constant, so A^k[i][j] == (i+1) * S^(k-1), where S = 1+2+...+N. The
+// power is computed twice with the same workspace: the first call warms up
+// the workspace, the second is timed and should allocate nothing.
+//
+void RunPower(int N, int T, int k)
+{
+	double **A, **B, TL, TR, BL, BR;
+	CreateAndFillMatrices(N, N, N, A, B, TL, TR, BL, BR);
+
+	double** D = New2dMatrix<double>(N, N);
+	MMWorkspace W;
+
+	cout << "Power: " << k << endl;
+	cout << "Num threads: " << T << endl;
+	cout << endl;
+
+	MatrixPower(A, k, D, N, T, W);
+
+	long warmupAllocs = W.Allocations();
+
+    auto start = chrono::high_resolution_clock::now();
+
+	MatrixPower(A, k, D, N, T, W);
+
+    auto stop = chrono::high_resolution_clock::now();
+	double secs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	double dN = N;
+	double Sk = pow(dN * (dN + 1.0) / 2.0, k - 1);
+
+	CheckCorners(D, N, N, Sk, Sk, dN * Sk, dN * Sk, k * MMTraits<double>::Tolerance(N));
+
+	cout << "Workspace allocations: " << warmupAllocs << " warmup, "
+	     << W.Allocations() - warmupAllocs << " after warmup" << endl;
+	cout << endl;
+	cout << "** Done!  Time: " << secs << " secs" << endl;
+
+	Delete2dMatrix(A);
+	Delete2dMatrix(B);
+	Delete2dMatrix(D);
+}
+
+
+//
+// RunChain:
+//
+// Multiplies the chain M0 * M1 * ... * Mn-1, where Mi is dims[i] x dims[i+1].
+// M0 looks like A in CreateAndFillMatrices (row r is all r+1), the rest are
+// all 1s, so every element in row r of the product is (r+1) times the product
+// of the inner dimensions. As with RunPower, the second call is timed.
+//
+void RunChain(const vector<int> &dims, int T)
+{
+	int n = dims.size() - 1;
+
+	vector<double**> mats(n);
+	for (int m = 0; m < n; m++)
+	{
+		mats[m] = New2dMatrix<double>(dims[m], dims[m+1]);
+
+		for (int r = 0; r < dims[m]; r++)
+			for (int c = 0; c < dims[m+1]; c++)
+				mats[m][r][c] = (m == 0) ? r + 1 : 1;
+	}
+
+	int ROWS = dims[0], COLS = dims[n];
+	double** D = New2dMatrix<double>(ROWS, COLS);
+	MMWorkspace W;
+
+	//
+	// cost of the best order vs. multiplying left to right:
+	//
+	double best = MatrixChainOrder(dims.data(), n, W.Cost, W.Split);
+	double naive = 0.0;
+	for (int m = 1; m < n; m++)
+		naive += (double) dims[0] * dims[m] * dims[m+1];
+
+	cout << "Chain: " << n << " matrices, result " << ROWS << "x" << COLS << endl;
+	cout << "Num threads: " << T << endl;
+	cout << "Multiply-adds: " << best << " (left-to-right: " << naive << ")" << endl;
+	cout << endl;
+
+	MatrixChainMultiply(mats.data(), dims.data(), n, D, T, W);
+
+	long warmupAllocs = W.Allocations();
+
+    auto start = chrono::high_resolution_clock::now();
+
+	MatrixChainMultiply(mats.data(), dims.data(), n, D, T, W);
+
+    auto stop = chrono::high_resolution_clock::now();
+	double secs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	double inner = 1.0;
+	for (int m = 1; m < n; m++)
+		inner *= dims[m];
+
+	CheckCorners(D, ROWS, COLS, inner, inner, ROWS * inner, ROWS * inner, n * MMTraits<double>::Tolerance(COLS));
+
+	cout << "Workspace allocations: " << warmupAllocs << " warmup, "
+	     << W.Allocations() - warmupAllocs << " after warmup" << endl;
+	cout << endl;
+	cout << "** Done!  Time: " << secs << " secs" << endl;
+
+	for (int m = 0; m < n; m++)
+		Delete2dMatrix(mats[m]);
+	Delete2dMatrix(D);
+}
+
+
+//
+// CreateAndFillMatrices:  fills A (MxK) and B (KxN) with predefined values, and then set TL, TR,
+// BL and BR to the expected top-left, top-right, bottom-left and bottom-right values after the
+// multiply.
+//
+template <class E> void CreateAndFillMatrices(int M, int K, int N, E** &A, E** &B, double &TL, double &TR, double &BL, double &BR)
+{
+	A = New2dMatrix<E>(M, K);
+	B = New2dMatrix<E>(K, N);
 
 	//
 	// A looks like:  
@@ -108,11 +679,11 @@ void CreateAndFillMatrices(int N, double** &A, double** &B, double &TL, double &
 	//   2  2  2  2  ...  2
 	//   .  .  .  .  ...  .
 	//   .  .  .  .  ...  .
-	//   N  N  N  N  ...  N
+	//   M  M  M  M  ...  M
 	//
-	for (int r = 0; r < N /*rows*/; r++)
-		for (int c = 0; c < N /*cols*/; c++)
-			A[r][c] = r + 1;
+	for (int r = 0; r < M /*rows*/; r++)
+		for (int c = 0; c < K /*cols*/; c++)
+			A[r][c] = (float) (r + 1);
 
 	//
 	// B looks like:
@@ -122,31 +693,78 @@ void CreateAndFillMatrices(int N, double** &A, double** &B, double &TL, double &
 	//   .  .  .  .  ...  .
 	//   1  2  3  4  ...  N
 	//
-	for (int r = 0; r < N /*rows*/; r++)
+	for (int r = 0; r < K /*rows*/; r++)
 		for (int c = 0; c < N /*cols*/; c++)
-			B[r][c] = c + 1;
+			B[r][c] = (float) (c + 1);
 
 	//
-	// expected values:
+	// expected values: since every row of A and every column of B is constant,
+	// C[i][j] == K * A[i][0] * B[0][j]. Use the *stored* values, since bf16
+	// can only represent integers exactly up to 256:
 	//
-	double dN = N;  // use double to overflow errors with large N:
+	double dK = K;  // use double to overflow errors with large K:
+	double a1 = (float) A[0][0], aM = (float) A[M-1][0];
+	double b1 = (float) B[0][0], bN = (float) B[0][N-1];
  
-	TL = dN;        // C[0,0] == Sum(1..1)
-	TR = dN*dN;     // C[0,N-1] == Sum(N..N)
-	BL = dN*dN;     // C[N-1, 0] == Sum(N..N)
-	BR = dN*dN*dN;  // C[N-1, N-1] == SUM(N^2..N^2)
+	TL = dK*a1*b1;  // C[0,0] == Sum(1..1)
+	TR = dK*a1*bN;  // C[0,N-1] == Sum(N..N)
+	BL = dK*aM*b1;  // C[M-1, 0] == Sum(M..M)
+	BR = dK*aM*bN;  // C[M-1, N-1] == SUM(MN..MN)
 }
 
 
 //
-// Checks the results against some expected results:
+// Checks the results against some expected results, allowing for the
+// rounding error of summing K products in the accumulation type (see
+// MMTraits in mm.h):
 //
-void CheckResults(int N, double** C, double TL, double TR, double BL, double BR)
+template <class E> void CheckResults(int M, int K, int N, typename MMTraits<E>::Accum** C, double TL, double TR, double BL, double BR)
 { 
-	bool b1 = ( fabs(C[0][0]     - TL) < 0.0000001 );
-	bool b2 = ( fabs(C[0][N-1]   - TR) < 0.0000001 );
-	bool b3 = ( fabs(C[N-1][0]   - BL) < 0.0000001 );
-	bool b4 = ( fabs(C[N-1][N-1] - BR) < 0.0000001 );
+	CheckCorners(C, M, N, TL, TR, BL, BR, MMTraits<E>::Tolerance(K));
+}
+
+
+//
+// Verify: checks every element of C = A * B with Freivalds' test (see
+// freivalds.h), allowing the same rounding error as CheckResults, and
+// reports the time it took against the multiply's.
+//
+template <class E> void Verify(E** const A, E** const B, typename MMTraits<E>::Accum** C, int M, int K, int N, int T, double multiplySecs)
+{
+	const int trials = 2;  // random vectors; one is enough in theory
+	double worst;
+
+	auto start = chrono::high_resolution_clock::now();
+
+	bool ok = Freivalds::Check(A, B, C, M, K, N, T, trials, MMTraits<E>::Tolerance(K), worst);
+
+	auto stop = chrono::high_resolution_clock::now();
+	double secs = chrono::duration<double>(stop - start).count();
+
+	cout << "Verify: Freivalds, " << trials << " random vectors, worst error "
+	     << 100.0 * worst << "% of tolerance, " << secs << " secs";
+	if (multiplySecs > 0.0)
+		cout << " (" << 100.0 * secs / multiplySecs << "% of the multiply)";
+	cout << endl;
+
+	if (!ok)
+	{
+		cout << "** ERROR: matrix multiply yielded incorrect results" << endl << endl;
+		exit(0);
+	}
+}
+
+
+//
+// CheckCorners: checks the four corners of the ROWSxCOLS matrix C, allowing
+// a relative error of rel.
+//
+template <class Accum> void CheckCorners(Accum** C, int ROWS, int COLS, double TL, double TR, double BL, double BR, double rel)
+{
+	bool b1 = ( fabs(C[0][0]           - TL) < 0.0000001 + rel * TL );
+	bool b2 = ( fabs(C[0][COLS-1]      - TR) < 0.0000001 + rel * TR );
+	bool b3 = ( fabs(C[ROWS-1][0]      - BL) < 0.0000001 + rel * BL );
+	bool b4 = ( fabs(C[ROWS-1][COLS-1] - BR) < 0.0000001 + rel * BR );
 
 	if (!b1 || !b2 || !b3 || !b4)
 	{
@@ -166,7 +784,7 @@ void ProcessCmdLineArgs(int argc, char* argv[])
 
 		if (strcmp(argv[i], "-?") == 0)  // help:
 		{
-			cout << "**Usage: mm [-?] [-n MatrixSize] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: mm [-?] [-n MatrixSize] [-m Rows] [-k Inner] [-t NumThreads] [-p double|float|bf16] [-density D] [-power K] [-chain d0,d1,...,dn] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-partition auto|rows|cols|inner|recursive] [-tiled] [-verify]" << endl << endl;
 			exit(0);
 		}
 		else if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))  // matrix size:
@@ -174,15 +792,126 @@ void ProcessCmdLineArgs(int argc, char* argv[])
 			i++;
 			_matrixSize = atoi(argv[i]);
 		}
+		else if ((strcmp(argv[i], "-m") == 0) && (i+1 < argc))  // rows of A and C:
+		{
+			i++;
+			_rows = atoi(argv[i]);
+		}
+		else if ((strcmp(argv[i], "-k") == 0) && (i+1 < argc))  // cols of A, rows of B:
+		{
+			i++;
+			_inner = atoi(argv[i]);
+		}
 		else if ((strcmp(argv[i], "-t") == 0) && (i+1 < argc))  // # of threads:
 		{
 			i++;
 			_numThreads = atoi(argv[i]);
 		}
+		else if ((strcmp(argv[i], "-p") == 0) && (i+1 < argc))  // element type:
+		{
+			i++;
+			_elemType = argv[i];
+
+			if (_elemType != "double" && _elemType != "float" && _elemType != "bf16")
+			{
+				cout << "**Unknown element type: '" << argv[i] << "'" << endl;
+				cout << "**Usage: mm [-?] [-n MatrixSize] [-m Rows] [-k Inner] [-t NumThreads] [-p double|float|bf16] [-density D] [-power K] [-chain d0,d1,...,dn] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-partition auto|rows|cols|inner|recursive] [-tiled] [-verify]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-density") == 0) && (i+1 < argc))  // fraction of non-zeros in A:
+		{
+			i++;
+			_density = atof(argv[i]);
+
+			if (_density <= 0.0 || _density > 1.0)
+			{
+				cout << "**Density must be in (0, 1]: '" << argv[i] << "'" << endl;
+				cout << "**Usage: mm [-?] [-n MatrixSize] [-m Rows] [-k Inner] [-t NumThreads] [-p double|float|bf16] [-density D] [-power K] [-chain d0,d1,...,dn] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-partition auto|rows|cols|inner|recursive] [-tiled] [-verify]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-power") == 0) && (i+1 < argc))  // compute A^K:
+		{
+			i++;
+			_power = atoi(argv[i]);
+
+			if (_power < 1)
+			{
+				cout << "**Power must be >= 1: '" << argv[i] << "'" << endl;
+				cout << "**Usage: mm [-?] [-n MatrixSize] [-m Rows] [-k Inner] [-t NumThreads] [-p double|float|bf16] [-density D] [-power K] [-chain d0,d1,...,dn] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-partition auto|rows|cols|inner|recursive] [-tiled] [-verify]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if (strcmp(argv[i], "-perf") == 0)  // hardware counters:
+		{
+			_perf = true;
+		}
+		else if (strcmp(argv[i], "-tiled") == 0)  // tiled storage:
+		{
+			_tiled = true;
+		}
+		else if (strcmp(argv[i], "-verify") == 0)  // check all of C:
+		{
+			_verify = true;
+		}
+		else if ((strcmp(argv[i], "-partition") == 0) && (i+1 < argc))  // how to divide the multiply:
+		{
+			i++;
+
+			if (strcmp(argv[i], "auto") == 0)
+				SetPartition(MM_AUTO);
+			else if (strcmp(argv[i], "rows") == 0)
+				SetPartition(MM_SPLIT_M);
+			else if (strcmp(argv[i], "cols") == 0)
+				SetPartition(MM_SPLIT_N);
+			else if (strcmp(argv[i], "inner") == 0)
+				SetPartition(MM_SPLIT_K);
+			else if (strcmp(argv[i], "recursive") == 0)
+				SetPartition(MM_RECURSIVE);
+			else
+			{
+				cout << "**Unknown partition: '" << argv[i] << "'" << endl;
+				cout << "**Usage: mm [-?] [-n MatrixSize] [-m Rows] [-k Inner] [-t NumThreads] [-p double|float|bf16] [-density D] [-power K] [-chain d0,d1,...,dn] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-partition auto|rows|cols|inner|recursive] [-tiled] [-verify]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-chain") == 0) && (i+1 < argc))  // chain dimensions:
+		{
+			i++;
+			_chainDims.clear();
+
+			stringstream ss(argv[i]);
+			string dim;
+			while (getline(ss, dim, ','))
+				_chainDims.push_back(atoi(dim.c_str()));
+
+			bool ok = (_chainDims.size() >= 2);
+			for (int d : _chainDims)
+				ok = ok && (d > 0);
+
+			if (!ok)
+			{
+				cout << "**Chain needs 2 or more positive dimensions: '" << argv[i] << "'" << endl;
+				cout << "**Usage: mm [-?] [-n MatrixSize] [-m Rows] [-k Inner] [-t NumThreads] [-p double|float|bf16] [-density D] [-power K] [-chain d0,d1,...,dn] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-partition auto|rows|cols|inner|recursive] [-tiled] [-verify]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-bind") == 0) && (i+1 < argc))  // thread placement:
+		{
+			i++;
+
+			if (!Affinity::SetPolicy(argv[i]))
+			{
+				cout << "**Unknown bind policy: '" << argv[i] << "'" << endl;
+				cout << "**Usage: mm [-?] [-n MatrixSize] [-m Rows] [-k Inner] [-t NumThreads] [-p double|float|bf16] [-density D] [-power K] [-chain d0,d1,...,dn] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-partition auto|rows|cols|inner|recursive] [-tiled] [-verify]" << endl << endl;
+				exit(0);
+			}
+		}
 		else  // error: unknown arg
 		{
 			cout << "**Unknown argument: '" << argv[i] << "'" << endl;
-			cout << "**Usage: mm [-?] [-n MatrixSize] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: mm [-?] [-n MatrixSize] [-m Rows] [-k Inner] [-t NumThreads] [-p double|float|bf16] [-density D] [-power K] [-chain d0,d1,...,dn] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-partition auto|rows|cols|inner|recursive] [-tiled] [-verify]" << endl << endl;
 			exit(0);
 		}
 
@@ -1,8 +1,12 @@
 /* mm.cpp */
 
 //
-// Matrix multiplication implementation, computing C=A*B where A and B
-// are NxN matrices. The resulting matrix C is therefore NxN.
+// Matrix multiplication implementation, computing C=A*B where A is MxK
+// and B is KxN. The resulting matrix C is therefore MxN (NxN in the
+// common square case).
+//
+// Instantiated for double, float and bf16 storage; see MMTraits in mm.h.
+// Also sparse (CSR) x dense kernels, see sparse.h.
 //
 #include <iostream>
 #include <string>
@@ -10,52 +14,651 @@
 
 #include "alloc2D.h"
 #include "mm.h"
+#include "chain.h"
+#include "numareport.h"
 #include <omp.h>
 
 using namespace std;
 
+static MMPartition _partition = MM_AUTO;  // see SetPartition
+
+template <class E>
+static void MultiplyInto(E** const A, E** const B, typename MMTraits<E>::Accum** C, int M, int K, int N, int T,
+                         MMWorkspace* W, int* rowNode);
+
 
 //
 // MatrixMultiply:
 //
-// Computes and returns C = A * B, where matrices are NxN. No attempt is made
-// to optimize the multiplication.
+// Computes and returns C = A * B, where matrices are NxN. Elements of A and
+// B are stored as type E, but are widened to MMTraits<E>::Accum before
+// multiplying, and C is accumulated (and returned) in that wider type.
 //
-double** MatrixMultiply(double** const A, double** const B, int N, int T)
+template <class E>
+typename MMTraits<E>::Accum** MatrixMultiply(E** const A, E** const B, int N, int T)
 {
-  double** C = New2dMatrix<double>(N, N);
+  return MatrixMultiply(A, B, N, N, N, T);
+}
+
+
+//
+// MatrixMultiply:
+//
+// Computes and returns C = A * B, where A is MxK and B is KxN, so C is MxN.
+// C is never touched before the multiply, so each page lands on the NUMA
+// node of the thread that zeroes (and computes) it; when splitting by rows,
+// that thread records its node in rowNode, see mm.h.
+//
+template <class E>
+typename MMTraits<E>::Accum** MatrixMultiply(E** const A, E** const B, int M, int K, int N, int T, int* rowNode)
+{
+  typedef typename MMTraits<E>::Accum Accum;
+
+  Accum** C = New2dMatrix<Accum>(M, N);
 
   //
   // Setup:
   //
   cout << "Num cores: " << get_nprocs() << endl;
   cout << "Num threads: " << T << endl;
+  cout << "Element type: " << MMTraits<E>::Name() << endl;
+  cout << "Partition: " << PartitionName(ChoosePartition(M, K, N, T)) << endl;
   cout << endl;
 
-  //
-  // Initialize target matrix in prep for summing:
-  //
-  for (int i = 0; i < N; i++)
-    for (int j = 0; j < N; j++)
-      C[i][j] = 0.0;
+  MultiplyInto(A, B, C, M, K, N, T, (MMWorkspace*) nullptr, rowNode);
 
   //
-  // For every row i of A and column j of B:
+  // return pointer to result matrix:
   //
-  #pragma omp parallel for num_threads(T) // THIS TELLS OPENMP TO PARALLELIZE FOR US
-  for (int i = 0; i < N; i++)
+  return C;
+}
+
+
+//
+// MatrixMultiply:
+//
+// Computes C = A * B into the caller's C, where matrices are NxN. Nothing
+// is allocated, so C can be reused from one multiply to the next.
+//
+template <class E>
+void MatrixMultiply(E** const A, E** const B, typename MMTraits<E>::Accum** C, int N, int T)
+{
+  MatrixMultiply(A, B, C, N, N, N, T);
+}
+
+
+//
+// ChoosePartition:
+//
+// Splitting the rows of C (M) is the default: threads write disjoint rows
+// and each reads all of B. When there are too few rows to keep T threads
+// busy, split the columns of C (N) instead, and when C is too small in both
+// directions (e.g. a short-wide A times a tall-skinny B), split the dot
+// products (K) and add up the threads' partial C's afterwards.
+//
+// The recursive (cache-oblivious) partition is only used when asked for,
+// via SetPartition.
+//
+MMPartition ChoosePartition(int M, int K, int N, int T)
+{
+  if (_partition != MM_AUTO)
+    return _partition;
+
+  if (T == 1 || M >= 4 * T)
+    return MM_SPLIT_M;
+  if (N >= 64 * T)  // enough columns for a few cache lines per thread
+    return MM_SPLIT_N;
+  if (K >= 64 * T)
+    return MM_SPLIT_K;
+
+  return MM_SPLIT_M;  // tiny, doesn't matter
+}
+
+void SetPartition(MMPartition P)
+{
+  _partition = P;
+}
+
+const char* PartitionName(MMPartition P)
+{
+  switch (P)
   {
-    for (int j = 0; j < N; j++)
+    case MM_AUTO:    return "auto";
+    case MM_SPLIT_M: return "rows (M)";
+    case MM_SPLIT_N: return "columns (N)";
+    case MM_SPLIT_K: return "inner dimension (K)";
+    case MM_RECURSIVE: return "recursive (tasks)";
+  }
+
+  return "?";
+}
+
+
+//
+// MultiplyBlock:
+//
+// Computes C[i][j] = sum of A[i][k] * B[k][j] over k0 <= k < k1, for rows
+// i0 <= i < i1 and columns j0 <= j < j1 of C. The block of C is zeroed
+// first, by the calling thread, just before it is computed --- unless
+// accumulate is true, in which case the sum is added to C.
+//
+// The loops are ordered i-k-j so the inner loop walks a row of B and a row
+// of C contiguously; this is what lets the widening conversion of B (e.g.
+// bf16 -> float) vectorize. Each C[i][j] still sums over k in order, so
+// results are identical to the textbook i-j-k order.
+//
+template <class E, class Accum>
+static void MultiplyBlock(E** const A, E** const B, Accum** C,
+                          int i0, int i1, int k0, int k1, int j0, int j1,
+                          bool accumulate = false)
+{
+  for (int i = i0; i < i1; i++)
+  {
+    Accum* Ci = C[i];
+
+    if (!accumulate)
+      for (int j = j0; j < j1; j++)
+        Ci[j] = 0.0;
+
+    for (int k = k0; k < k1; k++)
     {
-      for (int k = 0; k < N; k++)
+      Accum    a  = (Accum) A[i][k];
+      const E* Bk = B[k];
+
+      #pragma omp simd
+      for (int j = j0; j < j1; j++)
       {
-        C[i][j] += (A[i][k] * B[k][j]);
+        Ci[j] += (a * (Accum) Bk[j]);
       }
     }
   }
-  
-  //
-  // return pointer to result matrix:
-  //
+}
+
+
+//
+// MultiplyRecursive:
+//
+// Cache-oblivious C = A * B over the block i0..i1 x k0..k1 x j0..j1 (as in
+// MultiplyBlock): halve the largest of the three dimensions until the block
+// is small enough to stay in cache, whatever the cache sizes are, then run
+// MultiplyBlock. Halves of M or N write disjoint parts of C, so they run in
+// parallel as OpenMP tasks, when they're big enough to be worth a task;
+// halves of K write the same part of C, so they run one after the other,
+// the second accumulating. Either way each C[i][j] still sums over k in
+// order, so results are identical to the other partitions.
+//
+// N is halved on a multiple of 8 elements, so tasks don't share cache
+// lines of C.
+//
+template <class E, class Accum>
+static void MultiplyRecursive(E** const A, E** const B, Accum** C,
+                              int i0, int i1, int k0, int k1, int j0, int j1,
+                              bool accumulate)
+{
+  const int  LEAF = 64;                  // leaves are at most 64x64x64,
+  const long TASK = 8L * 64 * 64 * 64;   // tasks at least 8 leaves of work
+
+  int m = i1 - i0, k = k1 - k0, n = j1 - j0;
+
+  if (m <= LEAF && k <= LEAF && n <= LEAF)
+  {
+    MultiplyBlock(A, B, C, i0, i1, k0, k1, j0, j1, accumulate);
+    return;
+  }
+
+  bool spawn = ((long) m * k * n >= TASK);
+
+  if (k >= m && k >= n)  // split K, in order:
+  {
+    int kh = k0 + k / 2;
+
+    MultiplyRecursive(A, B, C, i0, i1, k0, kh, j0, j1, accumulate);
+    MultiplyRecursive(A, B, C, i0, i1, kh, k1, j0, j1, true);
+  }
+  else if (m >= n)  // split M:
+  {
+    int ih = i0 + m / 2;
+
+    #pragma omp task if(spawn)
+    MultiplyRecursive(A, B, C, i0, ih, k0, k1, j0, j1, accumulate);
+
+    MultiplyRecursive(A, B, C, ih, i1, k0, k1, j0, j1, accumulate);
+
+    #pragma omp taskwait
+  }
+  else  // split N:
+  {
+    int jh = j0 + max(8, (n / 2) / 8 * 8);
+
+    #pragma omp task if(spawn)
+    MultiplyRecursive(A, B, C, i0, i1, k0, k1, j0, jh, accumulate);
+
+    MultiplyRecursive(A, B, C, i0, i1, k0, k1, jh, j1, accumulate);
+
+    #pragma omp taskwait
+  }
+}
+
+
+//
+// NewPartials / DeletePartials:
+//
+// Scratch for the K split's partial C's: from W if there is one (doubles
+// only, that's all a workspace holds), so it's reused across calls and
+// counted in W.Allocations(); otherwise allocated for this call, and freed
+// at the end of it.
+//
+template <class Accum>
+static Accum** NewPartials(MMWorkspace* W, int ROWS, int COLS)
+{
+  return New2dMatrix<Accum>(ROWS, COLS);
+}
+
+template <>
+double** NewPartials<double>(MMWorkspace* W, int ROWS, int COLS)
+{
+  return (W != nullptr) ? W->Acquire(ROWS, COLS) : New2dMatrix<double>(ROWS, COLS);
+}
+
+template <class Accum>
+static void DeletePartials(MMWorkspace* W, Accum** P)
+{
+  Delete2dMatrix(P);
+}
+
+template <>
+void DeletePartials<double>(MMWorkspace* W, double** P)
+{
+  if (W != nullptr)
+    W->Release(P);
+  else
+    Delete2dMatrix(P);
+}
+
+
+//
+// MultiplyInto:
+//
+// Computes C = A * B into the caller's C, where A is MxK, B is KxN and C is
+// MxN. C must not overlap A or B. Work is divided among the threads as
+// ChoosePartition says. Nothing is allocated, except by the K split, which
+// needs a partial C per thread (C is small whenever the K split is chosen);
+// these come from W if given, see NewPartials. With the rows split among
+// the threads, rowNode (if not null) gets the node of each row's thread.
+//
+template <class E>
+static void MultiplyInto(E** const A, E** const B, typename MMTraits<E>::Accum** C, int M, int K, int N, int T,
+                         MMWorkspace* W, int* rowNode)
+{
+  typedef typename MMTraits<E>::Accum Accum;
+
+  MMPartition P = ChoosePartition(M, K, N, T);
+
+  if (P == MM_SPLIT_M)
+  {
+    //
+    // For every row i of A and row k of B:
+    //
+    #pragma omp parallel num_threads(T)
+    {
+      int node = (rowNode != nullptr) ? NumaCurrentNode() : 0;
+
+      #pragma omp for schedule(static) // THIS TELLS OPENMP TO PARALLELIZE FOR US
+      for (int i = 0; i < M; i++)
+      {
+        if (rowNode != nullptr)
+          rowNode[i] = node;
+
+        MultiplyBlock(A, B, C, i, i + 1, 0, K, 0, N);
+      }
+    }
+  }
+  else if (P == MM_SPLIT_N)
+  {
+    //
+    // each thread computes a block of columns of C, with block boundaries
+    // on multiples of 8 elements so threads don't share cache lines:
+    //
+    #pragma omp parallel num_threads(T)
+    {
+      int id = omp_get_thread_num();
+      int nt = omp_get_num_threads();
+      int units = (N + 7) / 8;
+
+      int j0 = min(N, 8 * (int) ((long) units * id / nt));
+      int j1 = min(N, 8 * (int) ((long) units * (id + 1) / nt));
+
+      MultiplyBlock(A, B, C, 0, M, 0, K, j0, j1);
+    }
+  }
+  else if (P == MM_RECURSIVE)
+  {
+    //
+    // one thread starts the recursion, the others pick up its tasks:
+    //
+    #pragma omp parallel num_threads(T)
+    #pragma omp single
+    MultiplyRecursive(A, B, C, 0, M, 0, K, 0, N, false);
+  }
+  else  // MM_SPLIT_K
+  {
+    //
+    // the partial C's are stacked into one (T*M)xN matrix, thread t's
+    // being rows t*M .. t*M+M-1; each is first touched by its own thread:
+    //
+    Accum** partials = NewPartials<Accum>(W, T * M, N);
+
+    #pragma omp parallel num_threads(T)
+    {
+      int id = omp_get_thread_num();
+      int nt = omp_get_num_threads();
+
+      //
+      // each thread sums its range of k into its own partial C:
+      //
+      int k0 = (int) ((long) K * id / nt);
+      int k1 = (int) ((long) K * (id + 1) / nt);
+
+      MultiplyBlock(A, B, &partials[id * M], 0, M, k0, k1, 0, N);
+
+      #pragma omp barrier
+
+      //
+      // then the threads add up the partials, in parallel over C:
+      //
+      #pragma omp for collapse(2)
+      for (int i = 0; i < M; i++)
+      {
+        for (int j = 0; j < N; j++)
+        {
+          Accum sum = 0.0;
+          for (int t = 0; t < nt; t++)
+            sum += partials[t * M + i][j];
+          C[i][j] = sum;
+        }
+      }
+    }
+
+    DeletePartials(W, partials);
+  }
+}
+
+
+//
+// MatrixMultiply:
+//
+// C = A * B into the caller's C, see MultiplyInto; the second form takes
+// the K split's scratch from W.
+//
+template <class E>
+void MatrixMultiply(E** const A, E** const B, typename MMTraits<E>::Accum** C, int M, int K, int N, int T)
+{
+  MultiplyInto(A, B, C, M, K, N, T, (MMWorkspace*) nullptr, (int*) nullptr);
+}
+
+void MatrixMultiply(double** const A, double** const B, double** C, int M, int K, int N, int T, MMWorkspace &W)
+{
+  MultiplyInto(A, B, C, M, K, N, T, &W, (int*) nullptr);
+}
+
+//
+// the element types we support:
+//
+template double** MatrixMultiply<double>(double** const A, double** const B, int N, int T);
+template double** MatrixMultiply<float>(float** const A, float** const B, int N, int T);
+template float**  MatrixMultiply<bfloat16>(bfloat16** const A, bfloat16** const B, int N, int T);
+
+template double** MatrixMultiply<double>(double** const A, double** const B, int M, int K, int N, int T, int* rowNode);
+template double** MatrixMultiply<float>(float** const A, float** const B, int M, int K, int N, int T, int* rowNode);
+template float**  MatrixMultiply<bfloat16>(bfloat16** const A, bfloat16** const B, int M, int K, int N, int T, int* rowNode);
+
+template void MatrixMultiply<double>(double** const A, double** const B, double** C, int N, int T);
+template void MatrixMultiply<float>(float** const A, float** const B, double** C, int N, int T);
+template void MatrixMultiply<bfloat16>(bfloat16** const A, bfloat16** const B, float** C, int N, int T);
+
+template void MatrixMultiply<double>(double** const A, double** const B, double** C, int M, int K, int N, int T);
+template void MatrixMultiply<float>(float** const A, float** const B, double** C, int M, int K, int N, int T);
+template void MatrixMultiply<bfloat16>(bfloat16** const A, bfloat16** const B, float** C, int M, int K, int N, int T);
+
+
+//
+// SparseMatrixVectorMultiply:
+//
+// Computes y = A * x, where A is sparse (CSR) and x and y are dense vectors.
+// Each thread computes the rows given to it by RowRangeByNNZ.
+//
+void SparseMatrixVectorMultiply(const CSRMatrix<double>* A, const double* x, double* y, int T)
+{
+  #pragma omp parallel num_threads(T)
+  {
+    int start, end;
+    RowRangeByNNZ(A, omp_get_thread_num(), omp_get_num_threads(), start, end);
+
+    for (int i = start; i < end; i++)
+    {
+      double sum = 0.0;
+
+      for (long p = A->RowPtr[i]; p < A->RowPtr[i + 1]; p++)
+        sum += A->Values[p] * x[A->ColIdx[p]];
+
+      y[i] = sum;
+    }
+  }
+}
+
+
+//
+// SparseMatrixMultiply:
+//
+// Computes and returns C = A * B, where A is sparse (CSR) and B is dense,
+// both NxN. Row i of C is the sum of the rows of B selected by the non-zeros
+// in row i of A, scaled by those non-zeros, so the inner loop is a
+// contiguous (vectorized) axpy over a row of B. Each thread zeroes its own
+// rows of C just before computing them.
+//
+double** SparseMatrixMultiply(const CSRMatrix<double>* A, double** const B, int N, int T)
+{
+  double** C = New2dMatrix<double>(N, N);
+
+  #pragma omp parallel num_threads(T)
+  {
+    int start, end;
+    RowRangeByNNZ(A, omp_get_thread_num(), omp_get_num_threads(), start, end);
+
+    for (int i = start; i < end; i++)
+    {
+      double* Ci = C[i];
+
+      for (int j = 0; j < N; j++)
+        Ci[j] = 0.0;
+
+      for (long p = A->RowPtr[i]; p < A->RowPtr[i + 1]; p++)
+      {
+        double        a  = A->Values[p];
+        const double* Bk = B[A->ColIdx[p]];
+
+        #pragma omp simd
+        for (int j = 0; j < N; j++)
+        {
+          Ci[j] += (a * Bk[j]);
+        }
+      }
+    }
+  }
+
   return C;
 }
+
+
+//
+// SparseMatrixMultiply:
+//
+// Computes and returns C = A * B, where A is sparse (CSC) and B is dense,
+// both NxN. Column k of A scales row k of B into the rows of C it has
+// non-zeros in, so different columns of A write the same rows of C; the
+// threads therefore divide C (and B) by columns, on multiples of 8
+// elements as in MatrixMultiply's column split, and each walks all of A,
+// doing a contiguous (vectorized) axpy over its part of the rows. Each
+// C[i][j] still sums over k in order, so results are identical to the CSR
+// version. Each thread zeroes its own columns of C first.
+//
+double** SparseMatrixMultiply(const CSCMatrix<double>* A, double** const B, int N, int T)
+{
+  double** C = New2dMatrix<double>(N, N);
+
+  #pragma omp parallel num_threads(T)
+  {
+    int id = omp_get_thread_num();
+    int nt = omp_get_num_threads();
+    int units = (N + 7) / 8;
+
+    int j0 = min(N, 8 * (int) ((long) units * id / nt));
+    int j1 = min(N, 8 * (int) ((long) units * (id + 1) / nt));
+
+    for (int i = 0; i < N; i++)
+      for (int j = j0; j < j1; j++)
+        C[i][j] = 0.0;
+
+    for (int k = 0; k < N; k++)
+    {
+      const double* Bk = B[k];
+
+      for (long p = A->ColPtr[k]; p < A->ColPtr[k + 1]; p++)
+      {
+        double  a  = A->Values[p];
+        double* Ci = C[A->RowIdx[p]];
+
+        #pragma omp simd
+        for (int j = j0; j < j1; j++)
+        {
+          Ci[j] += (a * Bk[j]);
+        }
+      }
+    }
+  }
+
+  return C;
+}
+
+
+//
+// MultiplyTile:
+//
+// C += A * B for one TILExTILE tile of each, all contiguous. C is computed
+// 8 rows x 4 columns at a time, kept in registers over the whole k loop, so
+// C is read and written once per tile rather than once per k. Each C[i][j]
+// still sums over k in order.
+//
+static void MultiplyTile(const double* A, const double* B, double* C)
+{
+  for (int i = 0; i < TILE; i += 8)
+  {
+    for (int j = 0; j < TILE; j += 4)
+    {
+      double c[8][4];
+
+      for (int r = 0; r < 8; r++)
+        for (int s = 0; s < 4; s++)
+          c[r][s] = C[(i + r) * TILE + j + s];
+
+      for (int k = 0; k < TILE; k++)
+      {
+        const double* Bk = B + k * TILE + j;
+
+        for (int r = 0; r < 8; r++)
+        {
+          double a = A[(i + r) * TILE + k];
+
+          #pragma omp simd
+          for (int s = 0; s < 4; s++)
+            c[r][s] += (a * Bk[s]);
+        }
+      }
+
+      for (int r = 0; r < 8; r++)
+        for (int s = 0; s < 4; s++)
+          C[(i + r) * TILE + j + s] = c[r][s];
+    }
+  }
+}
+
+
+//
+// MultiplyTiles:
+//
+// C += A * B over tile rows ti0..ti1-1, tile columns tj0..tj1-1 and inner
+// tiles tk0..tk1-1: MultiplyRecursive, but in units of tiles, halving the
+// largest dimension. On a square power-of-2 grid the halves are exactly the
+// Morton quadrants, so each task works on contiguous memory.
+//
+static void MultiplyTiles(const TiledMatrix<double>* A, const TiledMatrix<double>* B, TiledMatrix<double>* C,
+                          int ti0, int ti1, int tk0, int tk1, int tj0, int tj1)
+{
+  int m = ti1 - ti0, k = tk1 - tk0, n = tj1 - tj0;
+
+  if (m == 1 && n == 1)  // one tile of C, summed over k in order:
+  {
+    double* Cij = Tile(C, ti0, tj0);
+
+    for (int tk = tk0; tk < tk1; tk++)
+      MultiplyTile(Tile(A, ti0, tk), Tile(B, tk, tj0), Cij);
+    return;
+  }
+
+  bool spawn = ((long) m * k * n >= 8);  // tasks of at least 8 tile multiplies
+
+  if (k >= m && k >= n)  // split K, in order:
+  {
+    int kh = tk0 + k / 2;
+
+    MultiplyTiles(A, B, C, ti0, ti1, tk0, kh, tj0, tj1);
+    MultiplyTiles(A, B, C, ti0, ti1, kh, tk1, tj0, tj1);
+  }
+  else if (m >= n)  // split M:
+  {
+    int ih = ti0 + m / 2;
+
+    #pragma omp task if(spawn)
+    MultiplyTiles(A, B, C, ti0, ih, tk0, tk1, tj0, tj1);
+
+    MultiplyTiles(A, B, C, ih, ti1, tk0, tk1, tj0, tj1);
+
+    #pragma omp taskwait
+  }
+  else  // split N:
+  {
+    int jh = tj0 + n / 2;
+
+    #pragma omp task if(spawn)
+    MultiplyTiles(A, B, C, ti0, ti1, tk0, tk1, tj0, jh);
+
+    MultiplyTiles(A, B, C, ti0, ti1, tk0, tk1, jh, tj1);
+
+    #pragma omp taskwait
+  }
+}
+
+
+//
+// MatrixMultiply:
+//
+// Computes C = A * B where all three are tiled (see tiled.h): A is MxK, B
+// is KxN and C is MxN. C is zeroed, then the tiles are multiplied
+// recursively as OpenMP tasks. Padding is zero, so each C[i][j] sums
+// exactly what the row-major kernels sum, in the same order.
+//
+void MatrixMultiply(const TiledMatrix<double>* A, const TiledMatrix<double>* B, TiledMatrix<double>* C, int T)
+{
+  long numElements = (long) C->TileRows * C->TileCols * TILE * TILE;
+  double* elements = C->Elements;
+
+  #pragma omp parallel num_threads(T)
+  {
+    #pragma omp for simd schedule(static)
+    for (long e = 0; e < numElements; e++)
+      elements[e] = 0.0;
+
+    #pragma omp single
+    MultiplyTiles(A, B, C, 0, C->TileRows, 0, A->TileCols, 0, C->TileCols);
+  }
+}
@@ -4,4 +4,110 @@
 // Matrix Multiplication header file
 //
 
-double** MatrixMultiply(double** const A, double** const B, int N, int T);
+#pragma once
+
+#include <limits>
+
+#include "bfloat16.h"
+#include "sparse.h"
+#include "tiled.h"
+
+//
+// MMTraits: for each supported element (storage) type, the type used to
+// accumulate the dot products --- and hence the element type of C --- and
+// the relative error we tolerate when checking results. Summing N products
+// in type Accum can lose up to ~N ulps, so the tolerance scales with N.
+//
+template <class E> struct MMTraits;
+
+template <> struct MMTraits<double> {
+  typedef double Accum;
+  static const char* Name() { return "double"; }
+  static double Tolerance(int N) { return N * std::numeric_limits<Accum>::epsilon(); }
+};
+
+template <> struct MMTraits<float> {
+  typedef double Accum;
+  static const char* Name() { return "float"; }
+  static double Tolerance(int N) { return N * std::numeric_limits<Accum>::epsilon(); }
+};
+
+template <> struct MMTraits<bfloat16> {
+  typedef float Accum;
+  static const char* Name() { return "bf16"; }
+  static double Tolerance(int N) { return N * std::numeric_limits<Accum>::epsilon(); }
+};
+
+//
+// C = A * B, where A and B are NxN matrices of element type E. C is
+// allocated by the call, with element type MMTraits<E>::Accum.
+//
+template <class E>
+typename MMTraits<E>::Accum** MatrixMultiply(E** const A, E** const B, int N, int T);
+
+//
+// C = A * B, where A is MxK and B is KxN, so C is MxN. If rowNode (M ints)
+// is given and the rows of C are split among the threads (MM_SPLIT_M, see
+// below), the thread that computes row i --- and so first touches it ---
+// sets rowNode[i] to its NUMA node, for NumaReport (see numareport.h). The
+// other partitions have no one thread per row, and leave rowNode alone.
+//
+template <class E>
+typename MMTraits<E>::Accum** MatrixMultiply(E** const A, E** const B, int M, int K, int N, int T,
+                                             int* rowNode = nullptr);
+
+//
+// Same, but C is provided by the caller. Nothing is allocated, except that
+// the K split (see below) needs a partial C per thread, which is freed
+// before returning. The second form multiplies an MxK matrix A by a KxN
+// matrix B, yielding an MxN C. In both cases C must not overlap A or B.
+//
+template <class E>
+void MatrixMultiply(E** const A, E** const B, typename MMTraits<E>::Accum** C, int N, int T);
+
+template <class E>
+void MatrixMultiply(E** const A, E** const B, typename MMTraits<E>::Accum** C, int M, int K, int N, int T);
+
+//
+// Same, for doubles, with the one bit of scratch a multiply may need (the
+// per-thread partial C's of the K split) taken from W, so that repeated
+// multiplies allocate nothing after the first; see chain.h.
+//
+class MMWorkspace;
+
+void MatrixMultiply(double** const A, double** const B, double** C, int M, int K, int N, int T, MMWorkspace &W);
+
+//
+// How the dense multiplies divide the work among T threads: by rows of C,
+// by columns of C, by splitting the dot products (K) and then adding up
+// per-thread partial C's, or recursively, halving the largest dimension
+// and running the halves as OpenMP tasks. See ChoosePartition in mm.cpp;
+// SetPartition overrides its choice (MM_AUTO, the default, restores it).
+//
+enum MMPartition { MM_AUTO, MM_SPLIT_M, MM_SPLIT_N, MM_SPLIT_K, MM_RECURSIVE };
+
+MMPartition ChoosePartition(int M, int K, int N, int T);
+void        SetPartition(MMPartition P);
+const char* PartitionName(MMPartition P);
+
+//
+// Sparse kernels, where A is an NxN matrix in CSR form (see sparse.h) and
+// x, y, B and C are dense. Rows are divided among the T threads so each
+// gets about the same number of non-zeros.
+//
+//   SparseMatrixVectorMultiply: y = A * x, where y is provided by the caller.
+//   SparseMatrixMultiply:       returns C = A * B, allocated by the call.
+//
+// SparseMatrixMultiply also takes A in CSC form, in which case the columns
+// of C are divided among the threads instead.
+//
+void     SparseMatrixVectorMultiply(const CSRMatrix<double>* A, const double* x, double* y, int T);
+double** SparseMatrixMultiply(const CSRMatrix<double>* A, double** const B, int N, int T);
+double** SparseMatrixMultiply(const CSCMatrix<double>* A, double** const B, int N, int T);
+
+//
+// Tiled kernel, where A (MxK), B (KxN) and C (MxN) are in tiled form (see
+// tiled.h), double only. C is provided by the caller; its contents are
+// overwritten.
+//
+void MatrixMultiply(const TiledMatrix<double>* A, const TiledMatrix<double>* B, TiledMatrix<double>* C, int T);
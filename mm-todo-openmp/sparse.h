@@ -0,0 +1,200 @@
+/* sparse.h */
+
+//
+// Sparse matrix storage: compressed sparse row (CSR) and compressed sparse
+// column (CSC) formats. Only the non-zero elements are stored. For
+// example, in CSR form, here's a 3x4 matrix with 5 non-zeros:
+//
+//      | 5 0 0 2 |        RowPtr: 0 2 3 5
+//      | 0 0 7 0 |   ==>  ColIdx: 0 3 2 1 3
+//      | 0 1 0 4 |        Values: 5 2 7 1 4
+//
+// Row r's elements are Values[RowPtr[r] .. RowPtr[r+1]-1], in columns
+// ColIdx[RowPtr[r] .. RowPtr[r+1]-1]. CSC is the same idea by columns.
+//
+// Offsets are longs since NNZ can exceed 2^31 for large matrices.
+//
+
+#pragma once
+
+#include <omp.h>
+
+template <class T> struct CSRMatrix {
+  int   Rows;
+  int   Cols;
+  long  NNZ;
+  long* RowPtr;   // Rows+1 offsets
+  int*  ColIdx;   // NNZ column indices
+  T*    Values;   // NNZ values
+};
+
+template <class T> struct CSCMatrix {
+  int   Rows;
+  int   Cols;
+  long  NNZ;
+  long* ColPtr;   // Cols+1 offsets
+  int*  RowIdx;   // NNZ row indices
+  T*    Values;   // NNZ values
+};
+
+
+//
+// NewCSRMatrix: builds the CSR form of a dense ROWSxCOLS matrix (as returned
+// by New2dMatrix). Rows are counted and then copied in parallel, with a
+// sequential prefix sum in between.
+//
+template <class T>CSRMatrix<T> *NewCSRMatrix(T** const M, int ROWS, int COLS, int numThreads)
+{
+  CSRMatrix<T>* S = new CSRMatrix<T>;
+
+  S->Rows = ROWS;
+  S->Cols = COLS;
+  S->RowPtr = new long[ROWS + 1];
+
+  //
+  // count the non-zeros in each row, then prefix sum to get offsets:
+  //
+  #pragma omp parallel for num_threads(numThreads)
+  for (int r = 0; r < ROWS; r++)
+  {
+    long count = 0;
+    for (int c = 0; c < COLS; c++)
+      if (M[r][c] != 0)
+        count++;
+    S->RowPtr[r + 1] = count;
+  }
+
+  S->RowPtr[0] = 0;
+  for (int r = 0; r < ROWS; r++)
+    S->RowPtr[r + 1] += S->RowPtr[r];
+
+  S->NNZ = S->RowPtr[ROWS];
+  S->ColIdx = new int[S->NNZ];
+  S->Values = new T[S->NNZ];
+
+  //
+  // now each row knows where it goes, so copy in parallel:
+  //
+  #pragma omp parallel for num_threads(numThreads)
+  for (int r = 0; r < ROWS; r++)
+  {
+    long p = S->RowPtr[r];
+    for (int c = 0; c < COLS; c++)
+    {
+      if (M[r][c] != 0)
+      {
+        S->ColIdx[p] = c;
+        S->Values[p] = M[r][c];
+        p++;
+      }
+    }
+  }
+
+  return S;
+}
+
+
+//
+// NewCSCMatrix: builds the CSC form of a dense ROWSxCOLS matrix. Same as
+// NewCSRMatrix, but by columns.
+//
+template <class T>CSCMatrix<T> *NewCSCMatrix(T** const M, int ROWS, int COLS, int numThreads)
+{
+  CSCMatrix<T>* S = new CSCMatrix<T>;
+
+  S->Rows = ROWS;
+  S->Cols = COLS;
+  S->ColPtr = new long[COLS + 1];
+
+  #pragma omp parallel for num_threads(numThreads)
+  for (int c = 0; c < COLS; c++)
+  {
+    long count = 0;
+    for (int r = 0; r < ROWS; r++)
+      if (M[r][c] != 0)
+        count++;
+    S->ColPtr[c + 1] = count;
+  }
+
+  S->ColPtr[0] = 0;
+  for (int c = 0; c < COLS; c++)
+    S->ColPtr[c + 1] += S->ColPtr[c];
+
+  S->NNZ = S->ColPtr[COLS];
+  S->RowIdx = new int[S->NNZ];
+  S->Values = new T[S->NNZ];
+
+  #pragma omp parallel for num_threads(numThreads)
+  for (int c = 0; c < COLS; c++)
+  {
+    long p = S->ColPtr[c];
+    for (int r = 0; r < ROWS; r++)
+    {
+      if (M[r][c] != 0)
+      {
+        S->RowIdx[p] = r;
+        S->Values[p] = M[r][c];
+        p++;
+      }
+    }
+  }
+
+  return S;
+}
+
+
+//
+// RowRangeByNNZ: splits the rows of S into numThreads contiguous blocks
+// holding roughly equal numbers of non-zeros (rather than equal numbers of
+// rows), and returns the block for thread id as rows start .. end-1. Meant
+// to be called by each thread inside the parallel region.
+//
+template <class T>int FirstRowAtOffset(const CSRMatrix<T>* S, long target)
+{
+  //
+  // binary search for the first row whose starting offset reaches target:
+  //
+  int lo = 0, hi = S->Rows;
+
+  while (lo < hi)
+  {
+    int mid = lo + (hi - lo) / 2;
+    if (S->RowPtr[mid] < target)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+template <class T>void RowRangeByNNZ(const CSRMatrix<T>* S, int id, int numThreads, int &start, int &end)
+{
+  start = FirstRowAtOffset(S, (S->NNZ * id) / numThreads);
+
+  if (id + 1 == numThreads)  // last thread also takes any trailing empty rows:
+    end = S->Rows;
+  else
+    end = FirstRowAtOffset(S, (S->NNZ * (id + 1)) / numThreads);
+}
+
+
+//
+// DeleteCSRMatrix / DeleteCSCMatrix: returns memory associated with a sparse
+// matrix returned by NewCSRMatrix / NewCSCMatrix.
+//
+template <class T>void DeleteCSRMatrix(CSRMatrix<T>* S)
+{
+  delete[] S->RowPtr;
+  delete[] S->ColIdx;
+  delete[] S->Values;
+  delete S;
+}
+
+template <class T>void DeleteCSCMatrix(CSCMatrix<T>* S)
+{
+  delete[] S->ColPtr;
+  delete[] S->RowIdx;
+  delete[] S->Values;
+  delete S;
+}
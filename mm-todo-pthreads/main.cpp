@@ -6,8 +6,12 @@
 // Uses standard triply-nested loop, nothing special. For simplicity, the matrices 
 // are always square, i.e. we multiply NxN matrices, producing an NxN matrix.
 //
+// With -p float or -p bf16, A and B are stored in reduced precision (and
+// accumulated in double or float, respectively); the multiply is then
+// repeated in double to report the speedup.
+//
 // Usage:
-//   mm [-?] [-n MatrixSize] [-t NumThreads]
+//   mm [-?] [-n MatrixSize] [-t NumThreads] [-p double|float|bf16] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-verify]
 //
 // Author:
 //   Prof. Joe Hummel
@@ -19,10 +23,15 @@
 #include <cmath>
 #include <cstring>
 #include <chrono>
+#include <limits>
 #include <sys/sysinfo.h>
 
 #include "alloc2D.h"
 #include "mm.h"
+#include "affinity.h"
+#include "freivalds.h"
+#include "numareport.h"
+#include "perfcounters.h"
 
 using namespace std;
 
@@ -32,12 +41,17 @@ using namespace std;
 //
 static int _matrixSize;
 static int _numThreads;
+static string _elemType;  // double, float or bf16, see MMTraits in mm.h
+static bool _verify;  // check all of C, not just the corners?
+static bool _perf;    // hardware counters around the multiply?
 
 //
 // Function prototypes:
 //
-void CreateAndFillMatrices(int N, double** &A, double** &B, double &TL, double &TR, double &BL, double &BR);
-void CheckResults(int N, double** C, double TL, double TR, double BL, double BR);
+template <class E> double RunMultiply(int N, int T);
+template <class E> void CreateAndFillMatrices(int N, E** &A, E** &B, double &TL, double &TR, double &BL, double &BR);
+template <class E> void CheckResults(int N, typename MMTraits<E>::Accum** C, double TL, double TR, double BL, double BR);
+template <class E> void Verify(int N, E** A, E** B, typename MMTraits<E>::Accum** C, int T, double multiplySecs);
 void ProcessCmdLineArgs(int argc, char* argv[]);
 
 
@@ -51,45 +65,142 @@ int main(int argc, char *argv[])
 	//
 	_matrixSize = 2000;
 	_numThreads = get_nprocs();  // default to # of cores
+	_verify = false;
+	_perf = false;
+	_elemType = "double";
 
 	ProcessCmdLineArgs(argc, argv);
 
 	cout << "** Matrix Multiply Application **" << endl;
     cout << endl;
+	Affinity::Report(_numThreads);
 	cout << "Matrix size: " << _matrixSize << "x" << _matrixSize << endl;
 
+	//
+	// Multiply using the requested element type:
+	//
+	double secs;
+
+	if (_elemType == "float")
+		secs = RunMultiply<float>(_matrixSize, _numThreads);
+	else if (_elemType == "bf16")
+		secs = RunMultiply<bfloat16>(_matrixSize, _numThreads);
+	else
+		secs = RunMultiply<double>(_matrixSize, _numThreads);
+
+    cout << endl;
+    cout << "** Done!  Time: " << secs << " secs" << endl;
+
+	//
+	// for reduced precision, repeat in double so we can report the speedup:
+	//
+	if (_elemType != "double")
+	{
+		cout << endl;
+		cout << "** Baseline (double) run **" << endl;
+
+		double base = RunMultiply<double>(_matrixSize, _numThreads);
+
+		cout << endl;
+		cout << "** Baseline time: " << base << " secs" << endl;
+		if (secs > 0.0)
+			cout << "** Speedup vs double: " << base / secs << "x" << endl;
+	}
+
+	cout << "** Execution complete **" << endl;
+    cout << endl;
+
+	return 0;
+}
+
+
+//
+// RunMultiply:
+//
+// Creates NxN matrices A and B with elements of type E, multiplies, checks
+// the results, and returns the time of the multiply (in secs).
+//
+template <class E> double RunMultiply(int N, int T)
+{
+	typedef typename MMTraits<E>::Accum Accum;
+
 	//
 	// Create and fill the matrices to multiply:
 	//
-	double **A, **B, TL, TR, BL, BR;
-	CreateAndFillMatrices(_matrixSize, A, B, TL, TR, BL, BR);
+	E **A, **B;
+	double TL, TR, BL, BR;
+	CreateAndFillMatrices(N, A, B, TL, TR, BL, BR);
+
+	//
+	// What the multiply moves, at the least: A and B in the element type, C
+	// in the (possibly wider) accumulation type:
+	//
+	double dN = N;
+	double abBytes = 2.0 * dN * dN * sizeof(E);
+	double cBytes = dN * dN * sizeof(Accum);
+
+	cout << "Bytes: A+B " << abBytes / 1e6 << " MB (" << sizeof(E) << " per element), C "
+	     << cBytes / 1e6 << " MB (" << sizeof(Accum) << " per element)" << endl;
+
+	//
+	// With -perf, measure the roofline ceilings and create the counters (each
+	// thread opens and starts its own, see mm.cpp):
+	//
+	double peakGflops = 0.0, peakGBs = 0.0;
+	PerfCounters* counters = nullptr;
+
+	if (_perf)
+	{
+		PerfCounters::MeasureCeilings(T, peakGflops, peakGBs);
+		counters = new PerfCounters(T, false);
+	}
+
+	int* rowNode = new int[N];  // see MatrixMultiply
 
 	//
 	// Start clock and multiply:
 	//
     auto start = chrono::high_resolution_clock::now();
 
-	double** C = MatrixMultiply(A, B, _matrixSize, _numThreads);
+	Accum** C = MatrixMultiply(A, B, N, T, rowNode, counters);
   
     auto stop = chrono::high_resolution_clock::now();
     auto diff = stop - start;
     auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
 
+	if (_perf)
+	{
+		//
+		// 2 flops per multiply-add, and A, B and C each cross memory at least
+		// once:
+		//
+		cout << endl;
+		counters->Report(chrono::duration<double>(diff).count(), 2.0 * dN * dN * dN,
+		                 abBytes + cBytes, peakGflops, peakGBs);
+		delete counters;
+	}
+
 	//
-	// Done, check results and output timing:
+	// Where did the rows of C end up?
 	//
-	CheckResults(_matrixSize, C, TL, TR, BL, BR);
+	NumaReport(C, N, rowNode);
+	cout << endl;
 
-    cout << endl;
-    cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
-	cout << "** Execution complete **" << endl;
-    cout << endl;
+	delete[] rowNode;
+
+	//
+	// Done, check results:
+	//
+	CheckResults<E>(N, C, TL, TR, BL, BR);
+
+	if (_verify)
+		Verify(N, A, B, C, T, chrono::duration<double>(diff).count());
 
 	Delete2dMatrix(A);
 	Delete2dMatrix(B);
 	Delete2dMatrix(C);
 
-	return 0;
+	return duration.count() / 1000.0;
 }
 
 
@@ -97,10 +208,10 @@ int main(int argc, char *argv[])
 // CreateAndFillMatrices:  fills A and B with predefined values, and then set TL, TR, BL and BR
 // to the expected top-left, top-right, bottom-left and bottom-right values after the multiply.
 //
-void CreateAndFillMatrices(int N, double** &A, double** &B, double &TL, double &TR, double &BL, double &BR)
+template <class E> void CreateAndFillMatrices(int N, E** &A, E** &B, double &TL, double &TR, double &BL, double &BR)
 {
-	A = New2dMatrix<double>(N, N);
-	B = New2dMatrix<double>(N, N);
+	A = New2dMatrix<E>(N, N);
+	B = New2dMatrix<E>(N, N);
 
 	//
 	// A looks like:  
@@ -112,7 +223,7 @@ void CreateAndFillMatrices(int N, double** &A, double** &B, double &TL, double &
 	//
 	for (int r = 0; r < N /*rows*/; r++)
 		for (int c = 0; c < N /*cols*/; c++)
-			A[r][c] = r + 1;
+			A[r][c] = (float) (r + 1);
 
 	//
 	// B looks like:
@@ -124,29 +235,37 @@ void CreateAndFillMatrices(int N, double** &A, double** &B, double &TL, double &
 	//
 	for (int r = 0; r < N /*rows*/; r++)
 		for (int c = 0; c < N /*cols*/; c++)
-			B[r][c] = c + 1;
+			B[r][c] = (float) (c + 1);
 
 	//
-	// expected values:
+	// expected values: since every row of A and every column of B is constant,
+	// C[i][j] == N * A[i][0] * B[0][j]. Use the *stored* values, since bf16
+	// can only represent integers exactly up to 256:
 	//
 	double dN = N;  // use double to overflow errors with large N:
+	double a1 = (float) A[0][0], aN = (float) A[N-1][0];
+	double b1 = (float) B[0][0], bN = (float) B[0][N-1];
  
-	TL = dN;        // C[0,0] == Sum(1..1)
-	TR = dN*dN;     // C[0,N-1] == Sum(N..N)
-	BL = dN*dN;     // C[N-1, 0] == Sum(N..N)
-	BR = dN*dN*dN;  // C[N-1, N-1] == SUM(N^2..N^2)
+	TL = dN*a1*b1;  // C[0,0] == Sum(1..1)
+	TR = dN*a1*bN;  // C[0,N-1] == Sum(N..N)
+	BL = dN*aN*b1;  // C[N-1, 0] == Sum(N..N)
+	BR = dN*aN*bN;  // C[N-1, N-1] == SUM(N^2..N^2)
 }
 
 
 //
-// Checks the results against some expected results:
+// Checks the results against some expected results, allowing for the
+// rounding error of summing N products in the accumulation type (see
+// MMTraits in mm.h):
 //
-void CheckResults(int N, double** C, double TL, double TR, double BL, double BR)
+template <class E> void CheckResults(int N, typename MMTraits<E>::Accum** C, double TL, double TR, double BL, double BR)
 { 
-	bool b1 = ( fabs(C[0][0]     - TL) < 0.0000001 );
-	bool b2 = ( fabs(C[0][N-1]   - TR) < 0.0000001 );
-	bool b3 = ( fabs(C[N-1][0]   - BL) < 0.0000001 );
-	bool b4 = ( fabs(C[N-1][N-1] - BR) < 0.0000001 );
+	double rel = MMTraits<E>::Tolerance(N);
+
+	bool b1 = ( fabs(C[0][0]     - TL) < 0.0000001 + rel * TL );
+	bool b2 = ( fabs(C[0][N-1]   - TR) < 0.0000001 + rel * TR );
+	bool b3 = ( fabs(C[N-1][0]   - BL) < 0.0000001 + rel * BL );
+	bool b4 = ( fabs(C[N-1][N-1] - BR) < 0.0000001 + rel * BR );
 
 	if (!b1 || !b2 || !b3 || !b4)
 	{
@@ -156,6 +275,37 @@ void CheckResults(int N, double** C, double TL, double TR, double BL, double BR)
 }
 
 
+//
+// Verify: checks every element of C = A * B with Freivalds' test (see
+// freivalds.h), allowing the same rounding error as CheckResults, and
+// reports the time it took against the multiply's.
+//
+template <class E> void Verify(int N, E** A, E** B, typename MMTraits<E>::Accum** C, int T, double multiplySecs)
+{
+	const int trials = 2;  // random vectors; one is enough in theory
+	double worst;
+
+	auto start = chrono::high_resolution_clock::now();
+
+	bool ok = Freivalds::Check(A, B, C, N, N, N, T, trials, MMTraits<E>::Tolerance(N), worst);
+
+	auto stop = chrono::high_resolution_clock::now();
+	double secs = chrono::duration<double>(stop - start).count();
+
+	cout << "Verify: Freivalds, " << trials << " random vectors, worst error "
+	     << 100.0 * worst << "% of tolerance, " << secs << " secs";
+	if (multiplySecs > 0.0)
+		cout << " (" << 100.0 * secs / multiplySecs << "% of the multiply)";
+	cout << endl;
+
+	if (!ok)
+	{
+		cout << "** ERROR: matrix multiply yielded incorrect results" << endl << endl;
+		exit(0);
+	}
+}
+
+
 //
 // processCmdLineArgs:
 //
@@ -166,7 +316,7 @@ void ProcessCmdLineArgs(int argc, char* argv[])
 
 		if (strcmp(argv[i], "-?") == 0)  // help:
 		{
-			cout << "**Usage: mm [-?] [-n MatrixSize] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: mm [-?] [-n MatrixSize] [-t NumThreads] [-p double|float|bf16] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-verify]" << endl << endl;
 			exit(0);
 		}
 		else if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))  // matrix size:
@@ -179,10 +329,41 @@ void ProcessCmdLineArgs(int argc, char* argv[])
 			i++;
 			_numThreads = atoi(argv[i]);
 		}
+		else if ((strcmp(argv[i], "-p") == 0) && (i+1 < argc))  // element type:
+		{
+			i++;
+			_elemType = argv[i];
+
+			if (_elemType != "double" && _elemType != "float" && _elemType != "bf16")
+			{
+				cout << "**Unknown element type: '" << argv[i] << "'" << endl;
+				cout << "**Usage: mm [-?] [-n MatrixSize] [-t NumThreads] [-p double|float|bf16] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-verify]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-bind") == 0) && (i+1 < argc))  // thread placement:
+		{
+			i++;
+
+			if (!Affinity::SetPolicy(argv[i]))
+			{
+				cout << "**Unknown bind policy: '" << argv[i] << "'" << endl;
+				cout << "**Usage: mm [-?] [-n MatrixSize] [-t NumThreads] [-p double|float|bf16] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-verify]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if (strcmp(argv[i], "-perf") == 0)  // hardware counters:
+		{
+			_perf = true;
+		}
+		else if (strcmp(argv[i], "-verify") == 0)  // check all of C:
+		{
+			_verify = true;
+		}
 		else  // error: unknown arg
 		{
 			cout << "**Unknown argument: '" << argv[i] << "'" << endl;
-			cout << "**Usage: mm [-?] [-n MatrixSize] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: mm [-?] [-n MatrixSize] [-t NumThreads] [-p double|float|bf16] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-verify]" << endl << endl;
 			exit(0);
 		}
 
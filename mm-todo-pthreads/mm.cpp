@@ -10,37 +10,53 @@
 
 #include "alloc2D.h"
 #include "mm.h"
+#include "numareport.h"
+#include "perfcounters.h"
+#include "affinity.h"
 #include "pthread.h"
 
 using namespace std;
 
 //
-// struct for communicating with thread-based implementation:
+// struct for communicating with thread-based implementation, for element
+// type E (see MMTraits in mm.h):
 //
+template <class E>
 struct ThreadInfo {
+  typedef typename MMTraits<E>::Accum Accum;
+
   int      ID;
   int      NumThreads;
   int      N;
-  double** A;
-  double** B;
-  double** C;
-
-  ThreadInfo(int id, int t, int n, double** a, double** b, double** c)
-   : ID(id), NumThreads(t), N(n), A(a), B(b), C(c)
+  E**      A;
+  E**      B;
+  Accum**  C;
+  int*     RowNode;  // out: NUMA node of the thread that computed each row
+  PerfCounters* Counters;  // per-thread counters, or nullptr
+
+  ThreadInfo(int id, int t, int n, E** a, E** b, Accum** c, int* rowNode, PerfCounters* counters)
+   : ID(id), NumThreads(t), N(n), A(a), B(b), C(c), RowNode(rowNode), Counters(counters)
   { }
 };
 
+template <class E>
 static void* mm(void*);
 
 //
 // MatrixMultiply:
 //
 // Computes and returns C = A * B, where matrices are NxN. Does not make any attempt
-// to optimimization the multiplication.
+// to optimimization the multiplication. rowNode[i] is set to the NUMA node of
+// the thread that computed row i, for NumaReport. With counters, each thread
+// counts its own share of the work. The products are summed in (and C holds)
+// MMTraits<E>::Accum.
 //
-double** MatrixMultiply(double** const a, double** const b, int n, int t)
+template <class E>
+typename MMTraits<E>::Accum** MatrixMultiply(E** const a, E** const b, int n, int t, int* rowNode, PerfCounters* counters)
 {
-  double** c = New2dMatrix<double>(n, n);
+  typedef typename MMTraits<E>::Accum Accum;
+
+  Accum** c = New2dMatrix<Accum>(n, n);
 
   //
   // Setup:
@@ -49,14 +65,14 @@ double** MatrixMultiply(double** const a, double** const b, int n, int t)
 
   cout << "Num cores: " << cores << endl;
   cout << "Num threads: " << t << endl;
+  cout << "Element type: " << MMTraits<E>::Name() << endl;
   cout << endl;
 
   //
-  // Initialize target matrix in prep for summing:
+  // NOTE: c is not initialized here; each thread zeroes its own rows, so
+  // that the pages holding those rows are first touched --- and hence
+  // placed on the NUMA node of --- the thread that computes them.
   //
-  for (int i = 0; i < n; i++)
-    for (int j = 0; j < n; j++)
-      c[i][j] = 0.0;
 
   //
   // For starters, just execute using the main thread, nothing
@@ -66,14 +82,16 @@ double** MatrixMultiply(double** const a, double** const b, int n, int t)
   // THEO MAURINO CODE
   pthread_t* threads = new pthread_t[t]; // t must be a measurement of length? been a while for c++
   for (int i = 0; i < t; i++) {
-    struct ThreadInfo* info;
-    info = new ThreadInfo(
+    struct ThreadInfo<E>* info;
+    info = new ThreadInfo<E>(
       i,  //id
       t,
       n,
-      a, b, c
+      a, b, c,
+      rowNode,
+      counters
     );
-    pthread_create(&threads[i], nullptr, mm, (void*) info);
+    pthread_create(&threads[i], nullptr, mm<E>, (void*) info);
   }
 
 
@@ -88,7 +106,7 @@ double** MatrixMultiply(double** const a, double** const b, int n, int t)
   //                       a, b, c);
 
   for (int i = 0; i < t; i++) {
-    pthread_join([i], nullptr); // wait for threads to finish, nullptr means ignore return value
+    pthread_join(threads[i], nullptr); // wait for threads to finish, nullptr means ignore return value
   }
 
   delete[] threads; // clean up the array we made
@@ -119,9 +137,12 @@ double** MatrixMultiply(double** const a, double** const b, int n, int t)
 //   thread 2: rows 50..74
 //   thread 3: rows 75..99
 //
+template <class E>
 static void* mm(void* msg)
 {
-  struct ThreadInfo* info = (struct ThreadInfo*) msg;
+  typedef typename MMTraits<E>::Accum Accum;
+
+  struct ThreadInfo<E>* info = (struct ThreadInfo<E>*) msg;
 
   //
   // copy values out of struct so code is easier to read:
@@ -129,9 +150,15 @@ static void* mm(void* msg)
   int id = info->ID;
   int T  = info->NumThreads;
   int N  = info->N;
-  double** A = info->A;
-  double** B = info->B;
-  double** C = info->C;
+  E**     A = info->A;
+  E**     B = info->B;
+  Accum** C = info->C;
+
+  //
+  // bind ourselves per -bind (does nothing by default), before touching
+  // our rows of C:
+  //
+  Affinity::Pin(id);
 
   cout << "thread " << id << " starting" << endl;
   
@@ -153,6 +180,30 @@ static void* mm(void* msg)
       endRow += extra;
   }
   
+  //
+  // Initialize our rows of C in prep for summing, and note which NUMA
+  // node they are (first) touched from:
+  //
+  int node = NumaCurrentNode();
+
+  //
+  // hardware counters follow the thread that opens them, so each thread
+  // opens its own:
+  //
+  if (info->Counters != nullptr)
+  {
+    info->Counters->open_thread(id);
+    info->Counters->start_thread(id);
+  }
+
+  for (int i = startRow; i < endRow; i++)
+  {
+    for (int j = 0; j < N; j++)
+      C[i][j] = 0.0;
+
+    info->RowNode[i] = node;
+  }
+
   //
   // For every row i of A and column j of B:
   //
@@ -162,11 +213,14 @@ static void* mm(void* msg)
     {
       for (int k = 0; k < N; k++)
       {
-        C[i][j] += (A[i][k] * B[k][j]);
+        C[i][j] += ((Accum) A[i][k] * (Accum) B[k][j]);
       }
     }
   }
 
+  if (info->Counters != nullptr)
+    info->Counters->stop_thread(id);
+
   //
   // free struct that was passed to us:
   //
@@ -178,3 +232,11 @@ static void* mm(void* msg)
   //
   return nullptr;
 }
+
+
+//
+// the element types we support:
+//
+template double** MatrixMultiply<double>(double** const a, double** const b, int n, int t, int* rowNode, PerfCounters* counters);
+template double** MatrixMultiply<float>(float** const a, float** const b, int n, int t, int* rowNode, PerfCounters* counters);
+template float**  MatrixMultiply<bfloat16>(bfloat16** const a, bfloat16** const b, int n, int t, int* rowNode, PerfCounters* counters);
@@ -0,0 +1,86 @@
+/* numareport.h */
+
+//
+// NUMA locality report for a matrix allocated by New2dMatrix.
+//
+// On a NUMA machine, Linux places a page on the node of the thread that
+// first touches (writes) it. If C is zeroed by one thread, all of C ends
+// up on that thread's node, and threads on other nodes pay remote accesses
+// for every row they compute. The report shows where the rows of C ended
+// up, and how many are on the same node as the thread that computed them.
+//
+// Page locations come from the move_pages system call (in query mode, so
+// nothing moves); if that's not available the report just says so.
+//
+
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+//
+// NumaCurrentNode: the node of the CPU the calling thread is running on.
+//
+inline int NumaCurrentNode()
+{
+  unsigned cpu = 0, node = 0;
+
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+    return 0;
+
+  return (int) node;
+}
+
+//
+// NumaReport: rowNode[r] is the node of the thread that computed row r,
+// or nullptr if rows were not computed by a single thread. The first page
+// of each row is sampled.
+//
+template <class T>void NumaReport(T** C, int ROWS, const int* rowNode)
+{
+  void** pages  = new void*[ROWS];
+  int*   status = new int[ROWS];
+
+  for (int r = 0; r < ROWS; r++)
+    pages[r] = (void*) C[r];
+
+  long rc = syscall(SYS_move_pages, 0 /*this process*/, (unsigned long) ROWS, pages,
+                    nullptr /*query only*/, status, 0);
+
+  if (rc != 0)
+  {
+    std::cout << "NUMA: page locations unavailable" << std::endl;
+  }
+  else
+  {
+    std::map<int, int> rowsPerNode;
+    int local = 0;
+
+    for (int r = 0; r < ROWS; r++)
+    {
+      rowsPerNode[status[r]]++;  // a negative status is an error code
+
+      if (rowNode != nullptr && status[r] == rowNode[r])
+        local++;
+    }
+
+    std::cout << "NUMA: rows of C per node:";
+    for (auto& p : rowsPerNode)
+    {
+      if (p.first < 0)
+        std::cout << " unknown=" << p.second;
+      else
+        std::cout << " node" << p.first << "=" << p.second;
+    }
+    std::cout << std::endl;
+
+    if (rowNode != nullptr)
+      std::cout << "NUMA: rows local to their thread: "
+                << (100.0 * local) / ROWS << "%" << std::endl;
+  }
+
+  delete[] pages;
+  delete[] status;
+}
@@ -0,0 +1,456 @@
+/*perfcounters.h*/
+
+//
+// Hardware performance counters around a timed region, via perf_event_open.
+//
+// Each thread of an OpenMP team opens its own counters (cycles,
+// instructions, LLC misses, dTLB misses, and on Intel the FP_ARITH events
+// that count floating-point operations), so create the PerfCounters with
+// the same # of threads as the region being measured. Counts are summed
+// over threads and scaled for multiplexing. User-space only, which is
+// what perf_event_paranoid <= 2 allows.
+//
+// Threads that aren't an OpenMP team (pthreads, say) open their own
+// counters instead: create the PerfCounters with team = false, then thread
+// id calls open_thread(id) and start_thread(id) before its share of the
+// region, and stop_thread(id) after. Without OpenMP, MeasureCeilings runs
+// its kernels on std::threads.
+//
+// Counters are often unavailable (containers, VMs, paranoid settings); then
+// the report says so and falls back to the flop and byte counts the caller
+// computed from the problem size. Either way it prints GFLOP/s, GB/s, and
+// where the kernel sits on a roofline whose ceilings are measured on the
+// spot (see MeasureCeilings).
+//
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+class PerfCounters {
+    public:
+
+      enum Event {
+        CYCLES, INSTRUCTIONS, LLC_MISSES, DTLB_MISSES,
+        FP_SCALAR_DOUBLE, FP_128_DOUBLE, FP_256_DOUBLE,
+        FP_SCALAR_SINGLE, FP_128_SINGLE, FP_256_SINGLE,
+        NUM_EVENTS
+      };
+
+      PerfCounters(int T, bool team = true)
+        : fds(T, std::vector<int>(NUM_EVENTS, -1)), error(0), intel(IsIntel())
+      {
+        if (team)
+          OnThreads(T, [this](int tid) { open_thread(tid); });
+      }
+
+      ~PerfCounters()
+      {
+        for (auto& thread : fds)
+          for (int fd : thread)
+            if (fd >= 0)
+              close(fd);
+      }
+
+      // true if event e could be opened on every thread:
+      bool available(Event e) const
+      {
+        for (auto& thread : fds)
+          if (thread[e] < 0)
+            return false;
+        return true;
+      }
+
+      void start()
+      {
+        for (int tid = 0; tid < (int) fds.size(); tid++)
+          start_thread(tid);
+      }
+
+      void stop()
+      {
+        for (int tid = 0; tid < (int) fds.size(); tid++)
+          stop_thread(tid);
+      }
+
+      //
+      // open_thread: opens thread tid's counters; must be called by that
+      // thread, since the counters follow whoever opens them:
+      //
+      void open_thread(int tid)
+      {
+        for (int e = 0; e < NUM_EVENTS; e++)
+        {
+          if (e >= FP_SCALAR_DOUBLE && !intel)
+            continue;
+
+          fds[tid][e] = Open((Event) e);
+
+          if (fds[tid][e] < 0 && e == CYCLES)
+            error = errno;
+        }
+      }
+
+      void start_thread(int tid)
+      {
+        for (int fd : fds[tid])
+          if (fd >= 0)
+          {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+          }
+      }
+
+      void stop_thread(int tid)
+      {
+        for (int fd : fds[tid])
+          if (fd >= 0)
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+
+      //
+      // count: event e summed over threads, scaled up if the kernel had to
+      // multiplex it; -1 if unavailable:
+      //
+      double count(Event e) const
+      {
+        if (!available(e))
+          return -1.0;
+
+        double total = 0.0;
+
+        for (auto& thread : fds)
+        {
+          uint64_t values[3];  // value, time enabled, time running
+
+          if (read(thread[e], values, sizeof(values)) != sizeof(values))
+            return -1.0;
+
+          if (values[2] > 0)
+            total += (double) values[0] * values[1] / values[2];
+        }
+
+        return total;
+      }
+
+      //
+      // flops: FP operations from the FP_ARITH events (a packed instruction
+      // counts once per lane, an FMA counts twice); -1 if unavailable:
+      //
+      double flops() const
+      {
+        static const int lanes[] = { 1, 2, 4, 1, 4, 8 };
+        double total = 0.0;
+
+        for (int e = FP_SCALAR_DOUBLE; e < NUM_EVENTS; e++)
+        {
+          double n = count((Event) e);
+          if (n < 0.0)
+            return -1.0;
+          total += n * lanes[e - FP_SCALAR_DOUBLE];
+        }
+
+        return total;
+      }
+
+      //
+      // Report: prints the counters, GFLOP/s, GB/s and the roofline position
+      // for a region of secs seconds that (by the caller's count) performs
+      // flops FP operations and must move at least bytes bytes; ceilings
+      // are from MeasureCeilings.
+      //
+      void Report(double secs, double flops, double bytes, double peakGflops, double peakGBs) const
+      {
+        double cycles = count(CYCLES);
+        double instructions = count(INSTRUCTIONS);
+        double llc = count(LLC_MISSES);
+        double dtlb = count(DTLB_MISSES);
+        double counted = this->flops();
+
+        if (cycles < 0.0)
+          std::cout << "Counters:    unavailable (perf_event_open: " << strerror(error.load())
+                    << "), using flop and byte counts from the problem size" << std::endl;
+        else
+        {
+          std::cout << "Counters:    " << cycles << " cycles, " << instructions << " instructions";
+          if (cycles > 0.0 && instructions >= 0.0)
+            std::cout << " (IPC " << instructions / cycles << ")";
+          std::cout << std::endl;
+
+          std::cout << "             " << llc << " LLC misses, " << dtlb << " dTLB misses" << std::endl;
+        }
+
+        if (counted >= 0.0)
+        {
+          std::cout << "FP ops:      " << counted << " counted, " << flops << " expected" << std::endl;
+          flops = counted;
+        }
+
+        const char* traffic = "minimum, from the problem size";
+        if (llc >= 0.0 && llc * 64 > bytes)
+        {
+          bytes = llc * 64;  // every LLC miss moves a cache line
+          traffic = "LLC misses x 64 bytes";
+        }
+
+        double gflops = (secs > 0.0) ? flops / secs / 1e9 : 0.0;
+        double gbs = (secs > 0.0) ? bytes / secs / 1e9 : 0.0;
+
+        std::cout << "GFLOP/s:     " << gflops << std::endl;
+        std::cout << "GB/s:        " << gbs << " (" << traffic << ")" << std::endl;
+
+        if (bytes <= 0.0 || peakGBs <= 0.0)
+          return;
+
+        //
+        // roofline: the attainable rate at intensity AI is
+        // min(peak flops, AI * peak bandwidth), and the ridge point is where
+        // the two meet:
+        //
+        double ai = flops / bytes;
+        double ridge = peakGflops / peakGBs;
+        double roof = std::min(peakGflops, ai * peakGBs);
+
+        double percent = (roof > 0.0) ? 100.0 * gflops / roof : 0.0;
+
+        std::cout << "Roofline:    " << ai << " flops/byte vs ridge " << ridge << " => "
+                  << (ai < ridge ? "memory" : "compute") << "-bound, at "
+                  << percent << "% of the " << roof << " GFLOP/s roof" << std::endl;
+
+        //
+        // nothing runs above the roof, so if we did, a ceiling was measured
+        // too low (e.g. the machine was busy) and the position is meaningless:
+        //
+        if (percent > 100.0)
+          std::cout << "**WARNING: above the roof, so a measured ceiling is too low; "
+                    << "this roofline position is not valid" << std::endl;
+      }
+
+      //
+      // MeasureCeilings: the roofline's ceilings for T threads, measured
+      // with the same compiler flags as the kernels: peak GFLOP/s from
+      // independent multiply-adds on registers, peak GB/s from a STREAM
+      // triad over arrays well beyond the LLC. Takes a fraction of a second.
+      //
+      // For the flops to reach the peak, the multiply-adds must be limited
+      // by throughput, not latency: each thread keeps ACC independent chains,
+      // each a full SIMD register (as wide as the compiler flags allow), as
+      // plain locals so they stay in registers. 12 chains cover a 4-cycle
+      // multiply plus 4-cycle add on 2 ports with 2 registers to spare for
+      // the constants, even with only the 16 SSE registers.
+      //
+      static void MeasureCeilings(int T, double& peakGflops, double& peakGBs)
+      {
+        const long   N = 8 * 1024 * 1024;  // 64MB per array
+        const int    REPS = 3;
+        const long   ITERS = 4 * 1024 * 1024;
+        const int    ACC = 12;  // independent SIMD accumulators per thread, see above
+
+        double* a = new double[N];
+        double* b = new double[N];
+        double* c = new double[N];
+
+        //
+        // each thread first-touches, then streams, its own block:
+        //
+        auto block = [=](int tid, long& i0, long& i1) {
+          i0 = N * tid / T;
+          i1 = N * (tid + 1) / T;
+        };
+
+        OnThreads(T, [=](int tid) {
+          long i0, i1;
+          block(tid, i0, i1);
+
+          for (long i = i0; i < i1; i++)
+          {
+            a[i] = 0.0;
+            b[i] = 1.0;
+            c[i] = 2.0;
+          }
+        });
+
+        double best = 1e30;
+
+        for (int r = 0; r < REPS; r++)
+        {
+          auto start = std::chrono::high_resolution_clock::now();
+
+          OnThreads(T, [=](int tid) {
+            long i0, i1;
+            block(tid, i0, i1);
+
+            for (long i = i0; i < i1; i++)
+              a[i] = b[i] + 3.0 * c[i];
+          });
+
+          auto stop = std::chrono::high_resolution_clock::now();
+          best = std::min(best, std::chrono::duration<double>(stop - start).count());
+        }
+
+        peakGBs = 3.0 * N * sizeof(double) / best / 1e9;
+
+        delete[] a;
+        delete[] b;
+        delete[] c;
+
+        std::vector<double> sums(T, 0.0);  // keeps the chains alive
+        volatile double sink = 0.0;
+        best = 1e30;
+
+        for (int r = 0; r < REPS; r++)
+        {
+          auto start = std::chrono::high_resolution_clock::now();
+
+          OnThreads(T, [&sums](int tid) {
+            const Vector m = Vector{} + 0.999999, a = Vector{} + 0.000001;
+
+            Vector x0 = Vector{} + 0.0, x1 = Vector{} + 1.0, x2 = Vector{} + 2.0, x3 = Vector{} + 3.0;
+            Vector x4 = Vector{} + 4.0, x5 = Vector{} + 5.0, x6 = Vector{} + 6.0, x7 = Vector{} + 7.0;
+            Vector x8 = Vector{} + 8.0, x9 = Vector{} + 9.0, xa = Vector{} + 10.0, xb = Vector{} + 11.0;
+
+            for (long i = 0; i < ITERS / ACC; i++)
+            {
+              x0 = x0 * m + a;  x1 = x1 * m + a;  x2 = x2 * m + a;  x3 = x3 * m + a;
+              x4 = x4 * m + a;  x5 = x5 * m + a;  x6 = x6 * m + a;  x7 = x7 * m + a;
+              x8 = x8 * m + a;  x9 = x9 * m + a;  xa = xa * m + a;  xb = xb * m + a;
+            }
+
+            Vector v = ((x0 + x1) + (x2 + x3)) + ((x4 + x5) + (x6 + x7)) + ((x8 + x9) + (xa + xb));
+            double sum = 0.0;
+            for (int j = 0; j < LANES; j++)
+              sum += v[j];
+
+            sums[tid] = sum;
+          });
+
+          auto stop = std::chrono::high_resolution_clock::now();
+          best = std::min(best, std::chrono::duration<double>(stop - start).count());
+
+          for (double sum : sums)
+            sink = sink + sum;
+        }
+
+        peakGflops = 2.0 * (ITERS / ACC) * ACC * LANES * T / best / 1e9;
+
+        std::cout << "Ceilings:    " << peakGflops << " GFLOP/s, " << peakGBs
+                  << " GB/s (measured, " << T << " threads)" << std::endl;
+      }
+
+    private:
+
+      //
+      // Vector: the widest SIMD register the compiler flags allow, as a GCC
+      // vector of LANES doubles:
+      //
+#if defined(__AVX512F__)
+      static const int LANES = 8;
+#elif defined(__AVX__)
+      static const int LANES = 4;
+#else
+      static const int LANES = 2;
+#endif
+      typedef double Vector __attribute__((vector_size(LANES * sizeof(double))));
+
+      std::vector<std::vector<int>> fds;  // fds[thread][event], -1 if not open
+      std::atomic<int> error;             // errno from opening CYCLES, if it failed
+      bool intel;                         // FP_ARITH events available?
+
+      //
+      // OnThreads: runs body(tid) on each of T threads, as an OpenMP team if
+      // we have OpenMP, else on std::threads:
+      //
+      template <class Body>
+      static void OnThreads(int T, Body body)
+      {
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(T)
+        body(omp_get_thread_num());
+#else
+        std::vector<std::thread> threads;
+
+        for (int tid = 0; tid < T; tid++)
+          threads.emplace_back(body, tid);
+
+        for (std::thread& t : threads)
+          t.join();
+#endif
+      }
+
+      static int Open(Event e)
+      {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        const uint64_t DTLB_READ_MISS = PERF_COUNT_HW_CACHE_DTLB
+          | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+        //
+        // FP_ARITH_INST_RETIRED (event 0xC7), one umask per width:
+        //
+        static const uint64_t fp_umask[] = { 0x01, 0x04, 0x10, 0x02, 0x08, 0x20 };
+
+        switch (e)
+        {
+          case CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+          case INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+          case LLC_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+          case DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = DTLB_READ_MISS;
+            break;
+          default:
+            attr.type = PERF_TYPE_RAW;
+            attr.config = (fp_umask[e - FP_SCALAR_DOUBLE] << 8) | 0xC7;
+            break;
+        }
+
+        // pid 0, cpu -1 => the calling thread, wherever it runs:
+        return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      }
+
+      static bool IsIntel()
+      {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+
+        while (std::getline(cpuinfo, line))
+          if (line.compare(0, 9, "vendor_id") == 0)
+            return line.find("GenuineIntel") != std::string::npos;
+
+        return false;
+      }
+};
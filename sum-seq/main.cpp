@@ -3,10 +3,14 @@
 //
 // Matrix sum app
 //
-// Sums the contents of a random NxN matrix.
+// Sums the contents of a random NxN matrix. The sum is checked against a
+// reference sum computed independently, in parallel (see sumcheck.h);
+// -tolerance sets the relative error allowed. With -perf, the sum is
+// wrapped in hardware counters and placed on a roofline, see
+// perfcounters.h.
 //
 // Usage:
-//   sum [-?] [-n MatrixSize] [-t NumThreads]
+//   sum [-?] [-n MatrixSize] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tolerance R]
 //
 // Author:
 //   Prof. Joe Hummel
@@ -23,6 +27,9 @@
 
 #include "alloc2D.h"
 #include "sum.h"
+#include "affinity.h"
+#include "sumcheck.h"
+#include "perfcounters.h"
 
 using namespace std;
 
@@ -32,12 +39,14 @@ using namespace std;
 //
 static int _matrixSize;
 static int _numThreads;
+static double _tolerance;  // relative to the sum of |elements|
+static bool _perf;         // hardware counters around the sum?
 
 //
 // Function prototypes:
 //
 void CreateAndFillMatrix(int N, double** &M);
-void CheckResults(int N, double** M, double sum);
+void CheckResults(double sum, const SumReference& ref);
 void ProcessCmdLineArgs(int argc, char* argv[]);
 
 
@@ -51,11 +60,15 @@ int main(int argc, char *argv[])
 	//
 	_matrixSize = 20000;
 	_numThreads = 1;  // sequential execution
+	_tolerance = 1e-12;
+	_perf = false;
 
 	ProcessCmdLineArgs(argc, argv);
 
 	cout << "** Matrix Sum Application **" << endl;
     cout << endl;
+	Affinity::Report(_numThreads);
+	Affinity::BindOpenMP(_numThreads);
 	cout << "Matrix size: " << _matrixSize << "x" << _matrixSize << endl;
 
 	//
@@ -64,6 +77,20 @@ int main(int argc, char *argv[])
 	double **M;
 	CreateAndFillMatrix(_matrixSize, M);
 
+	//
+	// With -perf, measure the roofline ceilings and open the counters before
+	// starting the clock:
+	//
+	double peakGflops = 0.0, peakGBs = 0.0;
+	PerfCounters* counters = nullptr;
+
+	if (_perf)
+	{
+		PerfCounters::MeasureCeilings(_numThreads, peakGflops, peakGBs);
+		counters = new PerfCounters(_numThreads);
+		counters->start();
+	}
+
 	//
 	// Start clock and multiply:
 	//
@@ -75,12 +102,34 @@ int main(int argc, char *argv[])
     auto diff = stop - start;
     auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
 
+	if (_perf)
+	{
+		counters->stop();
+
+		//
+		// one add per element, and every element is read once:
+		//
+		double n = (double) _matrixSize * _matrixSize;
+
+		counters->Report(chrono::duration<double>(diff).count(), n, n * sizeof(double), peakGflops, peakGBs);
+		delete counters;
+	}
+
 	cout << "Sum: " << sum << endl;
 
 	//
-	// Done, check results and output timing:
+	// Done, check results (against an independent, parallel reference sum)
+	// and output timing:
 	//
-	CheckResults(_matrixSize, M, sum);
+	SumReference ref = ReferenceSum(M, _matrixSize, _matrixSize, _numThreads);
+
+	cout << "Verify: " << (ref.Exact ? "exact (integer-valued)" : "compensated")
+	     << " reference sum, " << ref.Secs << " secs";
+	if (duration.count() > 0)
+		cout << " (" << 100.0 * ref.Secs / (duration.count() / 1000.0) << "% of the sum)";
+	cout << endl;
+
+	CheckResults(sum, ref);
 
     cout << endl;
     cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
@@ -117,23 +166,18 @@ void CreateAndFillMatrix(int N, double** &M)
 
 
 //
-// Checks the results:
+// Checks the sum against the reference (see sumcheck.h), allowing a
+// relative error of _tolerance:
 //
-void CheckResults(int N, double** M, double sum)
+void CheckResults(double sum, const SumReference& ref)
 { 
-	double seq_sum = 0.0;
-
-	for (int r = 0; r < N; r++)
-	  for (int c = 0; c < N; c++)
-		seq_sum += M[r][c];
-
-	if (fabs(sum - seq_sum) < 0.000001) 
+	if (SumMatches(sum, ref, _tolerance)) 
 	{
 		cout << "Results are correct" << endl;
 	}
 	else 
 	{
-		cout << "** ERROR: matrix sum yielded incorrect results" << endl << endl;
+		cout << "** ERROR: matrix sum yielded incorrect results (expected " << ref.Sum << ")" << endl << endl;
 		exit(0);
 	}
 }
@@ -149,7 +193,7 @@ void ProcessCmdLineArgs(int argc, char* argv[])
 
 		if (strcmp(argv[i], "-?") == 0)  // help:
 		{
-			cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tolerance R]" << endl << endl;
 			exit(0);
 		}
 		else if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))  // matrix size:
@@ -162,10 +206,37 @@ void ProcessCmdLineArgs(int argc, char* argv[])
 			i++;
 			_numThreads = atoi(argv[i]);
 		}
+		else if ((strcmp(argv[i], "-bind") == 0) && (i+1 < argc))  // thread placement:
+		{
+			i++;
+
+			if (!Affinity::SetPolicy(argv[i]))
+			{
+				cout << "**Unknown bind policy: '" << argv[i] << "'" << endl;
+				cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tolerance R]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if (strcmp(argv[i], "-perf") == 0)  // hardware counters:
+		{
+			_perf = true;
+		}
+		else if ((strcmp(argv[i], "-tolerance") == 0) && (i+1 < argc))  // allowed relative error:
+		{
+			i++;
+			_tolerance = atof(argv[i]);
+
+			if (_tolerance < 0.0)
+			{
+				cout << "**Tolerance must be >= 0: '" << argv[i] << "'" << endl;
+				cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tolerance R]" << endl << endl;
+				exit(0);
+			}
+		}
 		else  // error: unknown arg
 		{
 			cout << "**Unknown argument: '" << argv[i] << "'" << endl;
-			cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tolerance R]" << endl << endl;
 			exit(0);
 		}
 
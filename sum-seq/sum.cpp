@@ -7,6 +7,7 @@
 #include <iostream>
 #include <string>
 #include <sys/sysinfo.h>
+#include <omp.h>
 
 #include "alloc2D.h"
 #include "sum.h"
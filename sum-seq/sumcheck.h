@@ -0,0 +1,212 @@
+/* sumcheck.h */
+
+//
+// Independent verification of a matrix sum. The reference sum is computed
+// in parallel, by a different algorithm than the kernels in sum.cpp, so a
+// bug in one is unlikely to be repeated in the other:
+//
+//   - the matrix is cut into blocks of 1024x1024 elements, and each block
+//     is walked by columns (top to bottom, 1024 columns at a time) rather
+//     than by rows; each thread takes whole blocks,
+//   - if every element of a block is an integer of magnitude <= 2^31
+//     (checked on the way), every partial sum of a column is an integer
+//     below 2^53, so summing in double is exact; the columns and blocks
+//     are then added up in 128-bit integers, and when the whole matrix is
+//     integer-valued the reference is exact,
+//   - otherwise the block is summed again, each column with compensated
+//     summation (Knuth's TwoSum), which is accurate to a few ulps whatever
+//     the order.
+//
+// Either way each column has its own accumulator, so the inner loop over a
+// row segment vectorizes.
+//
+// A sum then passes if it is within tolerance * (sum of |elements|) of the
+// reference: the rounding error of any order of summation is bounded by a
+// multiple of the sum of the magnitudes, not of the sum itself.
+//
+
+#pragma once
+
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+
+struct SumReference {
+  double Sum;        // the reference sum
+  double Magnitude;  // sum of |elements|
+  bool   Exact;      // integer-valued, so Sum is exact
+  double Secs;       // time to compute it
+};
+
+
+//
+// Neumaier: compensated summation; the running sum is s + c, where c holds
+// the low-order bits lost from s.
+//
+struct Neumaier {
+  double s = 0.0;
+  double c = 0.0;
+
+  void add(double v)
+  {
+    double t = s + v;
+    c += (std::fabs(s) >= std::fabs(v)) ? (s - t) + v : (v - t) + s;
+    s = t;
+  }
+
+  double value() const { return s + c; }
+};
+
+
+//
+// ReferenceSum: the reference sum of a ROWSxCOLS matrix (as returned by
+// New2dMatrix), computed with numThreads threads.
+//
+inline SumReference ReferenceSum(double** const M, int ROWS, int COLS, int numThreads)
+{
+  const int    BLOCK = 1024;
+  const double LIMIT = 2147483648.0;        // 2^31
+  const double ROUND = 6755399441055744.0;  // 1.5 * 2^52, see below
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  int blockRows = (ROWS + BLOCK - 1) / BLOCK;
+  int blockCols = (COLS + BLOCK - 1) / BLOCK;
+  int numBlocks = blockRows * blockCols;
+
+  std::vector<double>   sums(numBlocks), magnitudes(numBlocks);
+  std::vector<__int128> exact(numBlocks);
+  std::vector<char>     integer(numBlocks);
+
+  #pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+  for (int b = 0; b < numBlocks; b++)
+  {
+    int r0 = (b / blockCols) * BLOCK;
+    int c0 = (b % blockCols) * BLOCK;
+    int r1 = std::min(ROWS, r0 + BLOCK);
+    int cols = std::min(BLOCK, COLS - c0);
+
+    //
+    // integer pass: a sum per column, plus the sum of magnitudes (bm), the
+    // largest magnitude (top) and the largest fraction (frac). v is an
+    // integer iff (v + ROUND) - ROUND == v, since adding ROUND rounds away
+    // any fraction (for |v| < 2^51). So the block is integer-valued with
+    // |v| <= 2^31 iff frac == 0 and top <= LIMIT (a NaN shows up in bm),
+    // and then each column sum is an integer below 2^53, so it's exact:
+    //
+    double x[BLOCK];
+    double bm = 0.0, top = 0.0, frac = 0.0;
+
+    for (int c = 0; c < cols; c++)
+      x[c] = 0.0;
+
+    for (int r = r0; r < r1; r++)
+    {
+      const double* row = M[r] + c0;
+
+      #pragma omp simd reduction(+:bm) reduction(max:top, frac)
+      for (int c = 0; c < cols; c++)
+      {
+        double v = row[c];
+        double a = std::fabs(v);
+
+        top = std::max(top, a);
+        frac = std::max(frac, std::fabs(((v + ROUND) - ROUND) - v));
+        bm += a;
+        x[c] += v;
+      }
+    }
+
+    bool     bad = !(top <= LIMIT) || !(frac == 0.0) || !(bm == bm);
+    __int128 bx = 0;
+
+    if (!bad)
+      for (int c = 0; c < cols; c++)
+        bx += (long long) x[c];
+
+    exact[b] = bx;
+    magnitudes[b] = bm;
+    integer[b] = !bad;
+    sums[b] = (double) bx;
+
+    if (!bad)
+      continue;
+
+    //
+    // not integers, so sum again with compensation: TwoSum recovers the
+    // rounding error of each s + v exactly, without branches, and the
+    // errors are summed separately in e:
+    //
+    double s[BLOCK], e[BLOCK];
+
+    for (int c = 0; c < cols; c++)
+    {
+      s[c] = 0.0;
+      e[c] = 0.0;
+    }
+
+    for (int r = r0; r < r1; r++)
+    {
+      const double* row = M[r] + c0;
+
+      #pragma omp simd
+      for (int c = 0; c < cols; c++)
+      {
+        double v  = row[c];
+        double t  = s[c] + v;
+        double bv = t - s[c];
+
+        e[c] += (s[c] - (t - bv)) + (v - bv);
+        s[c] = t;
+      }
+    }
+
+    Neumaier bs;
+    for (int c = 0; c < cols; c++)
+    {
+      bs.add(s[c]);
+      bs.add(e[c]);
+    }
+
+    sums[b] = bs.value();
+  }
+
+  //
+  // combine the blocks, exactly if they're all integer-valued:
+  //
+  Neumaier s;
+  __int128 x = 0;
+  double   m = 0.0;
+  bool     whole = true;
+
+  for (int b = 0; b < numBlocks; b++)
+  {
+    s.add(sums[b]);
+    x += exact[b];
+    m += magnitudes[b];
+    whole = whole && integer[b];
+  }
+
+  auto stop = std::chrono::high_resolution_clock::now();
+
+  SumReference ref;
+
+  ref.Exact = whole;
+  ref.Sum = whole ? (double) x : s.value();
+  ref.Magnitude = m;
+  ref.Secs = std::chrono::duration<double>(stop - start).count();
+
+  return ref;
+}
+
+
+//
+// SumMatches: true if sum is within tolerance * (sum of |elements|) of the
+// reference:
+//
+inline bool SumMatches(double sum, const SumReference& ref, double tolerance)
+{
+  return std::fabs(sum - ref.Sum) <= tolerance * ref.Magnitude;
+}
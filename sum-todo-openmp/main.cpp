@@ -3,10 +3,24 @@
 //
 // Matrix sum app
 //
-// Sums the contents of a random NxN matrix.
+// Sums the contents of a random NxN matrix. With -density D < 1, each
+// element is non-zero with probability D, and the sum is repeated on the
+// sparse (CSR and CSC) forms of the same matrix to compare. With -tiled, the sum is
+// repeated on the tiled (Morton order) form, see tiled.h.
+//
+// Sums are checked against a reference sum computed independently, in
+// parallel (see sumcheck.h); -tolerance sets the relative error allowed.
+//
+// With -stats, also computes the statistics in LIST (comma-separated, from
+// sum, min, max, mean, variance, nonzeros, or all) in one fused pass, see
+// MatrixStats in sum.cpp.
+//
+// With -sat Q, builds the summed-area table of the matrix and answers Q
+// random rectangle sums from it, timed against summing rectangles directly
+// with MatrixSum (up to 100 of them, which are also checked).
 //
 // Usage:
-//   sum [-?] [-n MatrixSize] [-t NumThreads]
+//   sum [-?] [-n MatrixSize] [-t NumThreads] [-density D] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tiled] [-tolerance R] [-stats LIST] [-sat Q]
 //
 // Author:
 //   Prof. Joe Hummel
@@ -19,10 +33,15 @@
 #include <cstring>
 #include <chrono>
 #include <random>
+#include <vector>
+#include <algorithm>
 #include <sys/sysinfo.h>
 
 #include "alloc2D.h"
 #include "sum.h"
+#include "affinity.h"
+#include "perfcounters.h"
+#include "sumcheck.h"
 
 using namespace std;
 
@@ -32,12 +51,23 @@ using namespace std;
 //
 static int _matrixSize;
 static int _numThreads;
+static double _density;
+static bool _perf;  // hardware counters around the sum?
+static bool _tiled;  // also sum the tiled form?
+static double _tolerance;  // relative to the sum of |elements|
+static int _stats;  // MatrixStat bits for -stats, 0 => none
+static int _satQueries;  // rectangle queries for -sat, 0 => none
 
 //
 // Function prototypes:
 //
-void CreateAndFillMatrix(int N, double** &M);
-void CheckResults(int N, double** M, double sum);
+void CreateAndFillMatrix(int N, double** &M, double density);
+void RunSparse(int N, double** M, int T, double denseSecs, const SumReference& ref);
+void RunTiled(int N, double** M, int T, double denseSecs, const SumReference& ref);
+void RunStats(int N, double** M, int T, double denseSecs, const SumReference& ref);
+int ParseStats(const char* list);
+void RunSat(int N, double** M, int T, double denseSecs, const SumReference& ref);
+void CheckResults(double sum, const SumReference& ref);
 void ProcessCmdLineArgs(int argc, char* argv[]);
 
 
@@ -51,18 +81,40 @@ int main(int argc, char *argv[])
 	//
 	_matrixSize = 20000;
 	_numThreads = get_nprocs();  // default to # of cores:
+	_density = 1.0;  // dense
+	_perf = false;
+	_tiled = false;
+	_tolerance = 1e-12;
+	_stats = 0;
+	_satQueries = 0;
 
 	ProcessCmdLineArgs(argc, argv);
 
 	cout << "** Matrix Sum Application **" << endl;
     cout << endl;
+	Affinity::Report(_numThreads);
+	Affinity::BindOpenMP(_numThreads);
 	cout << "Matrix size: " << _matrixSize << "x" << _matrixSize << endl;
 
 	//
 	// Create and fill the matrix to sum:
 	//
 	double **M;
-	CreateAndFillMatrix(_matrixSize, M);
+	CreateAndFillMatrix(_matrixSize, M, _density);
+
+	//
+	// With -perf, measure the roofline ceilings and open the counters before
+	// starting the clock:
+	//
+	double peakGflops = 0.0, peakGBs = 0.0;
+	PerfCounters* counters = nullptr;
+
+	if (_perf)
+	{
+		PerfCounters::MeasureCeilings(_numThreads, peakGflops, peakGBs);
+		counters = new PerfCounters(_numThreads);
+		counters->start();
+	}
 
 	//
 	// Start clock and multiply:
@@ -75,15 +127,62 @@ int main(int argc, char *argv[])
     auto diff = stop - start;
     auto duration = chrono::duration_cast<chrono::milliseconds>(diff);
 
+	if (_perf)
+	{
+		counters->stop();
+
+		//
+		// one add per element, and every element is read once:
+		//
+		double n = (double) _matrixSize * _matrixSize;
+
+		counters->Report(chrono::duration<double>(diff).count(), n, n * sizeof(double), peakGflops, peakGBs);
+		delete counters;
+	}
+
 	cout << "Sum: " << sum << endl;
 
 	//
-	// Done, check results and output timing:
+	// Done, check results (against an independent, parallel reference sum)
+	// and output timing:
 	//
-	CheckResults(_matrixSize, M, sum);
+	SumReference ref = ReferenceSum(M, _matrixSize, _matrixSize, _numThreads);
+
+	cout << "Verify: " << (ref.Exact ? "exact (integer-valued)" : "compensated")
+	     << " reference sum, " << ref.Secs << " secs";
+	if (duration.count() > 0)
+		cout << " (" << 100.0 * ref.Secs / (duration.count() / 1000.0) << "% of the sum)";
+	cout << endl;
+
+	CheckResults(sum, ref);
 
     cout << endl;
     cout << "** Done!  Time: " << duration.count() / 1000.0 << " secs" << endl;
+
+	//
+	// Sparse? Then also sum the CSR form of the same matrix:
+	//
+	if (_density < 1.0)
+		RunSparse(_matrixSize, M, _numThreads, duration.count() / 1000.0, ref);
+
+	//
+	// Tiled? Then also sum the tiled form:
+	//
+	if (_tiled)
+		RunTiled(_matrixSize, M, _numThreads, duration.count() / 1000.0, ref);
+
+	//
+	// Statistics? Compute them in one pass:
+	//
+	if (_stats != 0)
+		RunStats(_matrixSize, M, _numThreads, duration.count() / 1000.0, ref);
+
+	//
+	// Rectangle sums? Build the summed-area table and query it:
+	//
+	if (_satQueries > 0)
+		RunSat(_matrixSize, M, _numThreads, duration.count() / 1000.0, ref);
+
 	cout << "** Execution complete **" << endl;
     cout << endl;
 
@@ -93,12 +192,283 @@ int main(int argc, char *argv[])
 }
 
 
+//
+// RunSparse:
+//
+// Converts M to CSR form and sums that, checking the result against the
+// reference and reporting the time against the dense time. Then does the
+// same in CSC form, which must agree (the non-zeros are summed in column
+// order rather than row order).
+//
+void RunSparse(int N, double** M, int T, double denseSecs, const SumReference& ref)
+{
+    auto start = chrono::high_resolution_clock::now();
+
+	CSRMatrix<double>* S = NewCSRMatrix(M, N, N, T);
+
+    auto stop = chrono::high_resolution_clock::now();
+	double buildSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+    start = chrono::high_resolution_clock::now();
+
+	double sum = MatrixSum(S, T);
+
+    stop = chrono::high_resolution_clock::now();
+	double sparseSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	cout << endl;
+	cout << "Density: " << _density << " (" << S->NNZ << " non-zeros)" << endl;
+	cout << "Sparse sum: " << sum << endl;
+
+	CheckResults(sum, ref);
+
+    start = chrono::high_resolution_clock::now();
+
+	CSCMatrix<double>* SC = NewCSCMatrix(M, N, N, T);
+
+    stop = chrono::high_resolution_clock::now();
+	double cscBuildSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+    start = chrono::high_resolution_clock::now();
+
+	double cscSum = MatrixSum(SC, T);
+
+    stop = chrono::high_resolution_clock::now();
+	double cscSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	cout << "CSC sum: " << cscSum << endl;
+
+	CheckResults(cscSum, ref);
+
+	cout << endl;
+	cout << "** CSR build time: " << buildSecs << " secs" << endl;
+	cout << "** Sparse time:    " << sparseSecs << " secs" << endl;
+	cout << "** CSC build time: " << cscBuildSecs << " secs" << endl;
+	cout << "** CSC time:       " << cscSecs << " secs" << endl;
+	if (sparseSecs > 0.0)
+		cout << "** Speedup of sparse vs dense: " << denseSecs / sparseSecs << "x" << endl;
+
+	DeleteCSRMatrix(S);
+	DeleteCSCMatrix(SC);
+}
+
+
+//
+// RunTiled:
+//
+// Converts M to tiled form and sums that, checking the result against the
+// reference and reporting the time against the dense time.
+//
+void RunTiled(int N, double** M, int T, double denseSecs, const SumReference& ref)
+{
+    auto start = chrono::high_resolution_clock::now();
+
+	TiledMatrix<double>* S = ToTiled(M, N, N, T);
+
+    auto stop = chrono::high_resolution_clock::now();
+	double buildSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+    start = chrono::high_resolution_clock::now();
+
+	double sum = MatrixSum(S, T);
+
+    stop = chrono::high_resolution_clock::now();
+	double tiledSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	cout << endl;
+	cout << "Tiles: " << TILE << "x" << TILE << ", " << S->TileRows << "x" << S->TileCols << " in Morton order" << endl;
+	cout << "Tiled sum: " << sum << endl;
+
+	CheckResults(sum, ref);
+
+	cout << endl;
+	cout << "** Tiled build time: " << buildSecs << " secs" << endl;
+	cout << "** Tiled time:       " << tiledSecs << " secs" << endl;
+	if (tiledSecs > 0.0)
+		cout << "** Speedup of tiled vs dense: " << denseSecs / tiledSecs << "x" << endl;
+
+	DeleteTiledMatrix(S);
+}
+
+
+//
+// RunStats:
+//
+// Computes the statistics selected with -stats in one pass (see
+// MatrixStats), checks the sum and mean against the reference, and reports
+// the time against the time of the sum alone.
+//
+void RunStats(int N, double** M, int T, double denseSecs, const SumReference& ref)
+{
+    auto start = chrono::high_resolution_clock::now();
+
+	MatrixStatistics stats = MatrixStats(M, N, T, _stats);
+
+    auto stop = chrono::high_resolution_clock::now();
+	double statsSecs = chrono::duration_cast<chrono::milliseconds>(stop - start).count() / 1000.0;
+
+	cout << endl;
+	cout << "Statistics (" << stats.Count << " elements):" << endl;
+
+	if (_stats & STAT_SUM)       cout << "  sum:      " << stats.Sum << endl;
+	if (_stats & STAT_MIN)       cout << "  min:      " << stats.Min << endl;
+	if (_stats & STAT_MAX)       cout << "  max:      " << stats.Max << endl;
+	if (_stats & STAT_MEAN)      cout << "  mean:     " << stats.Mean << endl;
+	if (_stats & STAT_VARIANCE)  cout << "  variance: " << stats.Variance << " (std dev " << sqrt(stats.Variance) << ")" << endl;
+	if (_stats & STAT_NONZEROS)  cout << "  nonzeros: " << stats.NonZeros << endl;
+
+	if (_stats & STAT_SUM)
+		CheckResults(stats.Sum, ref);
+	if (_stats & STAT_MEAN)
+		CheckResults(stats.Mean * stats.Count, ref);
+
+	cout << endl;
+	cout << "** Statistics time: " << statsSecs << " secs" << endl;
+	if (denseSecs > 0.0)
+		cout << "** vs the sum alone: " << statsSecs / denseSecs << "x the time" << endl;
+}
+
+
+//
+// RunSat:
+//
+// Builds the summed-area table of M (checking its corner, the sum of the
+// whole matrix, against the reference), answers _satQueries random
+// rectangle sums from it in one batch, and sums up to 100 of the same
+// rectangles directly to compare the time per rectangle and the results.
+//
+void RunSat(int N, double** M, int T, double denseSecs, const SumReference& ref)
+{
+    auto start = chrono::high_resolution_clock::now();
+
+	double** S = SummedAreaTable(M, N, T);
+
+    auto stop = chrono::high_resolution_clock::now();
+	double buildSecs = chrono::duration<double>(stop - start).count();
+
+	cout << endl;
+	cout << "Summed-area table: " << N + 1 << "x" << N + 1 << endl;
+	cout << "Table sum: " << S[N][N] << endl;
+
+	CheckResults(S[N][N], ref);
+
+	//
+	// random rectangles, the same every run:
+	//
+	int Q = _satQueries;
+	vector<Rect> rects(Q);
+	vector<double> sums(Q);
+
+	mt19937 generator(1);
+	uniform_int_distribution<> distribute(0, N - 1);
+
+	for (Rect& R : rects)
+	{
+		int r0 = distribute(generator), r1 = distribute(generator);
+		int c0 = distribute(generator), c1 = distribute(generator);
+
+		R.R0 = min(r0, r1);  R.R1 = max(r0, r1);
+		R.C0 = min(c0, c1);  R.C1 = max(c0, c1);
+	}
+
+    start = chrono::high_resolution_clock::now();
+
+	RectangleSums(S, rects.data(), Q, sums.data(), T);
+
+    stop = chrono::high_resolution_clock::now();
+	double querySecs = chrono::duration<double>(stop - start).count();
+
+	//
+	// the first few directly, for comparison:
+	//
+	int direct = min(Q, 100);
+	vector<double> directSums(direct);
+
+    start = chrono::high_resolution_clock::now();
+
+	for (int q = 0; q < direct; q++)
+		directSums[q] = MatrixSum(M, rects[q], T);
+
+    stop = chrono::high_resolution_clock::now();
+	double directSecs = chrono::duration<double>(stop - start).count();
+
+	for (int q = 0; q < direct; q++)
+	{
+		if (fabs(sums[q] - directSums[q]) > _tolerance * ref.Magnitude)
+		{
+			const Rect& R = rects[q];
+			cout << "** ERROR: rectangle [" << R.R0 << ".." << R.R1 << "]x[" << R.C0 << ".." << R.C1
+			     << "] sums to " << sums[q] << " from the table, " << directSums[q] << " directly" << endl << endl;
+			exit(0);
+		}
+	}
+
+	cout << "Rectangle sums: " << Q << " from the table, " << direct << " of them checked directly" << endl;
+
+	double perQuery = querySecs / Q, perDirect = directSecs / direct;
+
+	cout << endl;
+	cout << "** Table build time: " << buildSecs << " secs";
+	if (denseSecs > 0.0)
+		cout << " (" << buildSecs / denseSecs << "x the sum)";
+	cout << endl;
+	cout << "** Table queries:    " << querySecs << " secs, " << 1e9 * perQuery << " ns per rectangle" << endl;
+	cout << "** Direct sums:      " << directSecs << " secs, " << 1e9 * perDirect << " ns per rectangle" << endl;
+	if (perDirect > perQuery)
+		cout << "** Table pays off after " << (long) ceil(buildSecs / (perDirect - perQuery)) << " rectangles" << endl;
+
+	Delete2dMatrix(S);
+}
+
+
+//
+// ParseStats:
+//
+// Returns the MatrixStat bits for a comma-separated list of statistic
+// names, or 0 if a name is unknown.
+//
+int ParseStats(const char* list)
+{
+	const char* names[] = { "sum", "min", "max", "mean", "variance", "nonzeros" };
+	const int   bits[]  = { STAT_SUM, STAT_MIN, STAT_MAX, STAT_MEAN, STAT_VARIANCE, STAT_NONZEROS };
+
+	string rest = list;
+	int which = 0;
+
+	while (true)
+	{
+		size_t comma = rest.find(',');
+		string name = rest.substr(0, comma);
+		int bit = 0;
+
+		if (name == "all")
+			bit = STAT_ALL;
+
+		for (int i = 0; i < 6; i++)
+			if (name == names[i])
+				bit = bits[i];
+
+		if (bit == 0)
+			return 0;
+
+		which |= bit;
+
+		if (comma == string::npos)
+			break;
+		rest = rest.substr(comma + 1);
+	}
+
+	return which;
+}
+
+
 //
 // CreateAndFillMatrix:
 //
-// Creates an NxN matrix and fills with random values.
+// Creates an NxN matrix and fills with random values. Each element is 
+// non-zero with probability density (1.0 => every element).
 //
-void CreateAndFillMatrix(int N, double** &M)
+void CreateAndFillMatrix(int N, double** &M, double density)
 {
 	M = New2dMatrix<double>(N, N);
 
@@ -109,31 +479,27 @@ void CreateAndFillMatrix(int N, double** &M)
 	int max = 32767;
 
 	uniform_int_distribution<> distribute(min, max);
+	bernoulli_distribution keep(density);
 
 	for (int r = 0; r < N /*rows*/; r++)
 		for (int c = 0; c < N /*cols*/; c++)
-			M[r][c] = distribute(generator);
+			M[r][c] = (density >= 1.0 || keep(generator)) ? distribute(generator) : 0;
 }
 
 
 //
-// Checks the results:
+// Checks the sum against the reference (see sumcheck.h), allowing a
+// relative error of _tolerance:
 //
-void CheckResults(int N, double** M, double sum)
+void CheckResults(double sum, const SumReference& ref)
 { 
-	double seq_sum = 0.0;
-
-	for (int r = 0; r < N; r++)
-	  for (int c = 0; c < N; c++)
-		seq_sum += M[r][c];
-
-	if (fabs(sum - seq_sum) < 0.000001) 
+	if (SumMatches(sum, ref, _tolerance)) 
 	{
 		cout << "Results are correct" << endl;
 	}
 	else 
 	{
-		cout << "** ERROR: matrix sum yielded incorrect results" << endl << endl;
+		cout << "** ERROR: matrix sum yielded incorrect results (expected " << ref.Sum << ")" << endl << endl;
 		exit(0);
 	}
 }
@@ -149,7 +515,7 @@ void ProcessCmdLineArgs(int argc, char* argv[])
 
 		if (strcmp(argv[i], "-?") == 0)  // help:
 		{
-			cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-density D] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tiled] [-tolerance R] [-stats LIST] [-sat Q]" << endl << endl;
 			exit(0);
 		}
 		else if ((strcmp(argv[i], "-n") == 0) && (i+1 < argc))  // matrix size:
@@ -162,10 +528,77 @@ void ProcessCmdLineArgs(int argc, char* argv[])
 			i++;
 			_numThreads = atoi(argv[i]);
 		}
+		else if ((strcmp(argv[i], "-density") == 0) && (i+1 < argc))  // fraction of non-zeros:
+		{
+			i++;
+			_density = atof(argv[i]);
+
+			if (_density <= 0.0 || _density > 1.0)
+			{
+				cout << "**Density must be in (0, 1]: '" << argv[i] << "'" << endl;
+				cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-density D] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tiled] [-tolerance R] [-stats LIST] [-sat Q]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-bind") == 0) && (i+1 < argc))  // thread placement:
+		{
+			i++;
+
+			if (!Affinity::SetPolicy(argv[i]))
+			{
+				cout << "**Unknown bind policy: '" << argv[i] << "'" << endl;
+				cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-density D] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tiled] [-tolerance R] [-stats LIST] [-sat Q]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if (strcmp(argv[i], "-perf") == 0)  // hardware counters:
+		{
+			_perf = true;
+		}
+		else if (strcmp(argv[i], "-tiled") == 0)  // tiled storage:
+		{
+			_tiled = true;
+		}
+		else if ((strcmp(argv[i], "-tolerance") == 0) && (i+1 < argc))  // allowed relative error:
+		{
+			i++;
+			_tolerance = atof(argv[i]);
+
+			if (_tolerance < 0.0)
+			{
+				cout << "**Tolerance must be >= 0: '" << argv[i] << "'" << endl;
+				cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-density D] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tiled] [-tolerance R] [-stats LIST] [-sat Q]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-stats") == 0) && (i+1 < argc))  // fused statistics:
+		{
+			i++;
+			_stats = ParseStats(argv[i]);
+
+			if (_stats == 0)
+			{
+				cout << "**Unknown statistics: '" << argv[i] << "' (use sum,min,max,mean,variance,nonzeros or all)" << endl;
+				cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-density D] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tiled] [-tolerance R] [-stats LIST] [-sat Q]" << endl << endl;
+				exit(0);
+			}
+		}
+		else if ((strcmp(argv[i], "-sat") == 0) && (i+1 < argc))  // rectangle queries:
+		{
+			i++;
+			_satQueries = atoi(argv[i]);
+
+			if (_satQueries < 1)
+			{
+				cout << "**# of rectangle queries must be > 0: '" << argv[i] << "'" << endl;
+				cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-density D] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tiled] [-tolerance R] [-stats LIST] [-sat Q]" << endl << endl;
+				exit(0);
+			}
+		}
 		else  // error: unknown arg
 		{
 			cout << "**Unknown argument: '" << argv[i] << "'" << endl;
-			cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads]" << endl << endl;
+			cout << "**Usage: sum [-?] [-n MatrixSize] [-t NumThreads] [-density D] [-bind compact|spread|cores|list:CPUS|none] [-perf] [-tiled] [-tolerance R] [-stats LIST] [-sat Q]" << endl << endl;
 			exit(0);
 		}
 
@@ -2,11 +2,20 @@
 
 //
 // Matrix sum implementation, summing the contents of an 
-// NxN matrix.
+// NxN matrix. Also sums sparse (CSR) matrices, see sparse.h, and tiled
+// matrices, see tiled.h, computes several statistics in one pass, see
+// MatrixStats, and builds summed-area tables for rectangle sums, see
+// SummedAreaTable.
 //
 #include <iostream>
 #include <string>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <utility>
+#include <algorithm>
 #include <sys/sysinfo.h>
+#include <omp.h>
 
 #include "alloc2D.h"
 #include "sum.h"
@@ -43,3 +52,382 @@ double MatrixSum(double** M, int N, int T)
   
   return sum;
 }
+
+
+//
+// MatrixSum (sparse):
+//
+// Computes and returns the sum of a sparse matrix in CSR form. Only the
+// non-zeros are stored, and they are contiguous, so this is a reduction
+// over the Values array --- which also divides the work evenly among the
+// threads, however the non-zeros are spread across the rows. The same goes
+// for CSC, where the Values are in column order instead.
+//
+static double SumValues(const double* values, long nnz, int T)
+{
+  double sum = 0.0;
+
+  #pragma omp parallel for simd reduction(+:sum) num_threads(T)
+  for (long p = 0; p < nnz; p++)
+  {
+    sum += values[p];
+  }
+
+  return sum;
+}
+
+double MatrixSum(const CSRMatrix<double>* M, int T)
+{
+  return SumValues(M->Values, M->NNZ, T);
+}
+
+double MatrixSum(const CSCMatrix<double>* M, int T)
+{
+  return SumValues(M->Values, M->NNZ, T);
+}
+
+
+//
+// MatrixSum:
+//
+// Computes and returns the sum of a tiled matrix. The tiles, padding and
+// all, are one contiguous array (the padding is zero), so like the CSR sum
+// this is a single reduction; each thread's share is a run of whole tiles.
+//
+double MatrixSum(const TiledMatrix<double>* M, int T)
+{
+  double sum = 0.0;
+
+  const double* elements = M->Elements;
+  long numElements = (long) M->TileRows * M->TileCols * TILE * TILE;
+
+  #pragma omp parallel for simd reduction(+:sum) schedule(static) num_threads(T)
+  for (long e = 0; e < numElements; e++)
+  {
+    sum += elements[e];
+  }
+
+  return sum;
+}
+
+
+//
+// Partial statistics of a run of elements; two are combined with Merge.
+//
+struct Partial {
+  long   n = 0;
+  double sum = 0.0;
+  double mean = 0.0;
+  double m2 = 0.0;      // sum of squared deviations from mean
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+  long   nonzeros = 0;
+};
+
+
+//
+// Merge: combines partial b into a. The mean and m2 are combined with
+// Chan et al.'s formulas, which (unlike summing squares) don't lose
+// precision when the mean is large compared to the spread.
+//
+static void Merge(Partial& a, const Partial& b)
+{
+  if (b.n == 0)
+    return;
+
+  long   n = a.n + b.n;
+  double delta = b.mean - a.mean;
+
+  a.mean += delta * ((double) b.n / n);
+  a.m2 += b.m2 + delta * delta * ((double) a.n * b.n / n);
+  a.n = n;
+
+  a.sum += b.sum;
+  a.min = std::min(a.min, b.min);
+  a.max = std::max(a.max, b.max);
+  a.nonzeros += b.nonzeros;
+}
+
+
+//
+// StatsBlock:
+//
+// Adds the statistics of x[0..n-1] to p, for the statistics in K (the
+// MatrixStat bits, reduced to what's needed: the sum if the mean or the
+// variance is wanted, and so on). K is a template argument so that each
+// combination gets its own SIMD loop, computing nothing it doesn't need.
+//
+// Blocks are small enough to stay in L1, so the variance, which needs the
+// block's mean first, costs a second pass over the block in cache, not a
+// second pass over memory; the block's m2 is then exact up to rounding,
+// and Merge folds it in.
+//
+template <int K>
+static void StatsBlock(const double* x, int n, Partial& p)
+{
+  const bool SUM = (K & STAT_SUM) != 0, MIN = (K & STAT_MIN) != 0, MAX = (K & STAT_MAX) != 0;
+  const bool VAR = (K & STAT_VARIANCE) != 0, NNZ = (K & STAT_NONZEROS) != 0;
+
+  double sum = 0.0;
+  double lo = std::numeric_limits<double>::infinity();
+  double hi = -std::numeric_limits<double>::infinity();
+  long   nz = 0;
+
+  #pragma omp simd reduction(+:sum, nz) reduction(min:lo) reduction(max:hi)
+  for (int i = 0; i < n; i++)
+  {
+    double v = x[i];
+
+    if (SUM) sum += v;
+    if (MIN) lo = std::min(lo, v);
+    if (MAX) hi = std::max(hi, v);
+    if (NNZ) nz += (v != 0.0);
+  }
+
+  Partial b;
+
+  b.n = n;
+  b.sum = sum;
+  b.min = lo;
+  b.max = hi;
+  b.nonzeros = nz;
+
+  if (VAR)
+  {
+    double mean = sum / n, m2 = 0.0;
+
+    #pragma omp simd reduction(+:m2)
+    for (int i = 0; i < n; i++)
+      m2 += (x[i] - mean) * (x[i] - mean);
+
+    b.mean = mean;
+    b.m2 = m2;
+    Merge(p, b);
+  }
+  else  // no need for Chan's formulas:
+  {
+    p.n += n;
+    p.sum += sum;
+    p.min = std::min(p.min, lo);
+    p.max = std::max(p.max, hi);
+    p.nonzeros += nz;
+  }
+}
+
+
+typedef void (*StatsBlockFn)(const double*, int, Partial&);
+
+template <int... K>
+static StatsBlockFn StatsBlockFor(int k, std::integer_sequence<int, K...>)
+{
+  static const StatsBlockFn table[] = { StatsBlock<K>... };
+  return table[k];
+}
+
+
+//
+// MatrixStats:
+//
+// Computes the statistics which of an NxN matrix, in one pass: each
+// thread takes a contiguous band of rows, and walks each row in blocks of
+// 1024 elements (see StatsBlock), accumulating a Partial; the threads'
+// partials are then merged in order, so the result doesn't depend on
+// timing.
+//
+MatrixStatistics MatrixStats(double** M, int N, int T, int which)
+{
+  const int BLOCK = 1024;  // 8KB of doubles, a quarter of L1
+
+  //
+  // what the kernel must compute: the sum for the mean and the variance,
+  // and the mean is derived from the sum:
+  //
+  int k = which & (STAT_SUM | STAT_MIN | STAT_MAX | STAT_VARIANCE | STAT_NONZEROS);
+  if (which & (STAT_MEAN | STAT_VARIANCE))
+    k |= STAT_SUM;
+
+  StatsBlockFn block = StatsBlockFor(k, std::make_integer_sequence<int, STAT_ALL + 1>());
+
+  std::vector<Partial> partials(T);
+
+  #pragma omp parallel num_threads(T)
+  {
+    Partial& p = partials[omp_get_thread_num()];
+
+    #pragma omp for schedule(static)
+    for (int r = 0; r < N; r++)
+      for (int c = 0; c < N; c += BLOCK)
+        block(M[r] + c, std::min(BLOCK, N - c), p);
+  }
+
+  Partial all;
+  for (const Partial& p : partials)
+    Merge(all, p);
+
+  MatrixStatistics stats = MatrixStatistics();
+
+  stats.Which = which;
+  stats.Count = all.n;
+
+  if (which & STAT_SUM)      stats.Sum = all.sum;
+  if (which & STAT_MIN)      stats.Min = all.min;
+  if (which & STAT_MAX)      stats.Max = all.max;
+  if (which & STAT_NONZEROS) stats.NonZeros = all.nonzeros;
+
+  //
+  // without the variance, mean and m2 weren't tracked, but the sum was:
+  //
+  if ((which & STAT_MEAN) && all.n > 0)
+    stats.Mean = (which & STAT_VARIANCE) ? all.mean : all.sum / all.n;
+  if ((which & STAT_VARIANCE) && all.n > 0)
+    stats.Variance = all.m2 / all.n;
+
+  return stats;
+}
+
+
+//
+// MatrixSum:
+//
+// Computes and returns the sum of the sub-block R of a matrix; the rows
+// are divided among the threads, and each row segment is a SIMD reduction.
+//
+double MatrixSum(double** M, const Rect& R, int T)
+{
+  double sum = 0.0;
+
+  #pragma omp parallel for reduction(+:sum) schedule(static) num_threads(T)
+  for (int r = R.R0; r <= R.R1; r++)
+  {
+    const double* row = M[r];
+
+    #pragma omp simd reduction(+:sum)
+    for (int c = R.C0; c <= R.C1; c++)
+      sum += row[c];
+  }
+
+  return sum;
+}
+
+
+//
+// SummedAreaTable:
+//
+// Builds the summed-area table S of an NxN matrix (see sum.h) in two
+// parallel phases. The rows are cut into one band per thread.
+//
+//   1. Each thread scans its band on its own, as if the band were the
+//      whole matrix: each row is prefix-summed along the row (a SIMD scan,
+//      the running sum carried across lanes in registers), and the row
+//      above --- still in cache --- is added as it goes, so the row scan
+//      and the column scan are one sweep over the band.
+//
+//   2. Each band's rows are then short by the sum of every band above it,
+//      which is the sum of those bands' last rows: a carry row per band,
+//      accumulated down the bands (by columns, in parallel), then added to
+//      every row of the band (by rows, in parallel).
+//
+// So M is read once and S is written twice. The table is exact if M holds
+// integers and its total is below 2^53.
+//
+double** SummedAreaTable(double** M, int N, int T)
+{
+  double** S = New2dMatrix<double>(N + 1, N + 1);
+
+  std::vector<int> bands(T + 1);  // band b is rows bands[b] .. bands[b+1]-1 of M
+  for (int b = 0; b <= T; b++)
+    bands[b] = (int) ((long) N * b / T);
+
+  double** carry = New2dMatrix<double>(T, N + 1);  // carry[b]: sum of bands above b
+
+  #pragma omp parallel num_threads(T)
+  {
+    int nt = omp_get_num_threads();
+
+    #pragma omp for schedule(static)
+    for (int c = 0; c <= N; c++)
+      S[0][c] = 0.0;
+
+    //
+    // phase 1: scan each band, the first row against the zero row S[0]:
+    //
+    for (int b = omp_get_thread_num(); b < T; b += nt)
+    {
+      for (int r = bands[b]; r < bands[b + 1]; r++)
+      {
+        const double* m = M[r];
+        const double* above = (r == bands[b]) ? S[0] : S[r];
+        double*       s = S[r + 1];
+        double        run = 0.0;
+
+        s[0] = 0.0;
+
+        #pragma omp simd reduction(inscan, +:run)
+        for (int c = 0; c < N; c++)
+        {
+          run += m[c];
+          #pragma omp scan inclusive(run)
+          s[c + 1] = run + above[c + 1];
+        }
+      }
+    }
+
+    #pragma omp barrier
+
+    //
+    // phase 2: carries down the bands, by columns, then added to each row
+    // (band 0 has none):
+    //
+    #pragma omp for schedule(static)
+    for (int c = 0; c <= N; c++)
+    {
+      double sum = 0.0;
+
+      for (int b = 0; b < T; b++)
+      {
+        carry[b][c] = sum;
+        if (bands[b + 1] > bands[b])
+          sum += S[bands[b + 1]][c];
+      }
+    }
+
+    #pragma omp for schedule(static)
+    for (int r = bands[1]; r < N; r++)
+    {
+      int b = (int) (std::upper_bound(bands.begin(), bands.end(), r) - bands.begin()) - 1;
+
+      const double* add = carry[b];
+      double*       s = S[r + 1];
+
+      #pragma omp simd
+      for (int c = 0; c <= N; c++)
+        s[c] += add[c];
+    }
+  }
+
+  Delete2dMatrix(carry);
+
+  return S;
+}
+
+
+//
+// RectangleSums:
+//
+// The sum of each rectangle is
+//
+//   S[R1+1][C1+1] - S[R0][C1+1] - S[R1+1][C0] + S[R0][C0]
+//
+// 4 lookups whatever its size; the queries are divided among the threads.
+//
+void RectangleSums(double** S, const Rect* rects, int count, double* sums, int T)
+{
+  #pragma omp parallel for schedule(static) num_threads(T)
+  for (int q = 0; q < count; q++)
+  {
+    const Rect& R = rects[q];
+
+    sums[q] = S[R.R1 + 1][R.C1 + 1] - S[R.R0][R.C1 + 1]
+            - S[R.R1 + 1][R.C0] + S[R.R0][R.C0];
+  }
+}
@@ -4,4 +4,73 @@
 // Matrix Sum header file
 //
 
+#pragma once
+
+#include "sparse.h"
+#include "tiled.h"
+
 double MatrixSum(double** M, int N, int T);
+
+//
+// Sum of a sparse matrix in CSR or CSC form (see sparse.h):
+//
+double MatrixSum(const CSRMatrix<double>* M, int T);
+double MatrixSum(const CSCMatrix<double>* M, int T);
+
+//
+// Sum of a matrix in tiled form (see tiled.h):
+//
+double MatrixSum(const TiledMatrix<double>* M, int T);
+
+//
+// Statistics of an NxN matrix, computed together in one pass (see
+// MatrixStats); or these together to choose which:
+//
+enum MatrixStat {
+  STAT_SUM       = 1,
+  STAT_MIN       = 2,
+  STAT_MAX       = 4,
+  STAT_MEAN      = 8,
+  STAT_VARIANCE  = 16,
+  STAT_NONZEROS  = 32,
+  STAT_ALL       = 63
+};
+
+struct MatrixStatistics {
+  int    Which;     // the MatrixStat bits computed; other fields are 0
+  long   Count;     // # of elements
+  double Sum;
+  double Min;
+  double Max;
+  double Mean;
+  double Variance;  // population variance
+  long   NonZeros;
+};
+
+MatrixStatistics MatrixStats(double** M, int N, int T, int which = STAT_ALL);
+
+//
+// A rectangle of a matrix, rows R0..R1 and columns C0..C1, inclusive:
+//
+struct Rect {
+  int R0, C0;
+  int R1, C1;
+};
+
+//
+// Sum of the sub-block R of a matrix:
+//
+double MatrixSum(double** M, const Rect& R, int T);
+
+//
+// Summed-area table of an NxN matrix: an (N+1)x(N+1) matrix S (free with
+// Delete2dMatrix) where S[r][c] is the sum of the elements above and left
+// of M[r][c], i.e. of rows 0..r-1 and columns 0..c-1. Row 0 and column 0
+// are zero, so any rectangle's sum is 4 lookups, see RectangleSums.
+//
+double** SummedAreaTable(double** M, int N, int T);
+
+//
+// The sums of count rectangles, looked up in the summed-area table S:
+//
+void RectangleSums(double** S, const Rect* rects, int count, double* sums, int T);
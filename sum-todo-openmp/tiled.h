@@ -0,0 +1,192 @@
+/* tiled.h */
+
+//
+// Tiled matrix storage: the matrix is cut into TILExTILE tiles, each tile
+// is stored contiguously (row-major within the tile), and the tiles are
+// laid out in Morton (Z) order. For example, a 4x4 grid of tiles is stored
+//
+//      |  0  1  4  5 |
+//      |  2  3  6  7 |
+//      |  8  9 12 13 |
+//      | 10 11 14 15 |
+//
+// so every quadrant, at every level, is one contiguous run of memory. A
+// recursive algorithm that works on a quadrant touches one range of pages
+// rather than a stripe of every row, which is what keeps TLB misses down
+// for large N. When the grid of tiles isn't a square power of 2, tiles keep
+// their Morton order, with the gaps squeezed out (see TileIndex).
+//
+// Edge tiles are padded with zeros, so kernels can always work on whole
+// tiles: zeros add nothing to sums or products.
+//
+
+#pragma once
+
+#include <omp.h>
+#include <vector>
+#include <algorithm>
+
+const int TILE = 64;  // 64x64 doubles => a 32KB tile, 3 fit in L2
+
+template <class T> struct TiledMatrix {
+  int   Rows;
+  int   Cols;
+  int   TileRows;    // # of tiles down, i.e. ceil(Rows / TILE)
+  int   TileCols;    // # of tiles across
+  long* TileIndex;   // TileRows*TileCols, position of tile (tr, tc) in Morton order
+  T*    Elements;    // TileRows*TileCols tiles of TILE*TILE elements
+};
+
+
+//
+// MortonCode: interleaves the bits of row and col, row bits odd, col bits
+// even, so (0,0) (0,1) (1,0) (1,1) come out 0 1 2 3.
+//
+inline unsigned long MortonCode(unsigned int row, unsigned int col)
+{
+  unsigned long code = 0;
+
+  for (int b = 0; b < 32; b++)
+  {
+    code |= (unsigned long) ((col >> b) & 1) << (2 * b);
+    code |= (unsigned long) ((row >> b) & 1) << (2 * b + 1);
+  }
+
+  return code;
+}
+
+
+//
+// Tile: returns a pointer to tile (tr, tc) of S, TILE*TILE elements with
+// element (r, c) of the tile at [r * TILE + c].
+//
+template <class T>T *Tile(const TiledMatrix<T>* S, int tr, int tc)
+{
+  return S->Elements + S->TileIndex[(long) tr * S->TileCols + tc] * TILE * TILE;
+}
+
+
+//
+// NewTiledMatrix: allocates a tiled ROWSxCOLS matrix, zeroed (in parallel,
+// a tile per iteration).
+//
+template <class T>TiledMatrix<T> *NewTiledMatrix(int ROWS, int COLS, int numThreads)
+{
+  TiledMatrix<T>* S = new TiledMatrix<T>;
+
+  S->Rows = ROWS;
+  S->Cols = COLS;
+  S->TileRows = (ROWS + TILE - 1) / TILE;
+  S->TileCols = (COLS + TILE - 1) / TILE;
+
+  //
+  // rank the tiles by Morton code, which orders them along the Z curve
+  // with any gaps (non-square, non-power-of-2 grids) squeezed out:
+  //
+  long numTiles = (long) S->TileRows * S->TileCols;
+  std::vector<std::pair<unsigned long, long>> order(numTiles);
+
+  for (int tr = 0; tr < S->TileRows; tr++)
+    for (int tc = 0; tc < S->TileCols; tc++)
+    {
+      long t = (long) tr * S->TileCols + tc;
+      order[t] = std::make_pair(MortonCode(tr, tc), t);
+    }
+
+  std::sort(order.begin(), order.end());
+
+  S->TileIndex = new long[numTiles];
+  for (long p = 0; p < numTiles; p++)
+    S->TileIndex[order[p].second] = p;
+
+  S->Elements = new T[numTiles * TILE * TILE];
+
+  #pragma omp parallel for schedule(static) num_threads(numThreads)
+  for (long p = 0; p < numTiles; p++)
+  {
+    T* tile = S->Elements + p * TILE * TILE;
+
+    #pragma omp simd
+    for (int e = 0; e < TILE * TILE; e++)
+      tile[e] = 0;
+  }
+
+  return S;
+}
+
+
+//
+// ToTiled: builds the tiled form of a dense ROWSxCOLS matrix (as returned
+// by New2dMatrix). Each thread copies whole tiles, a contiguous run of
+// TILE elements from each of TILE rows.
+//
+template <class T>TiledMatrix<T> *ToTiled(T** const M, int ROWS, int COLS, int numThreads)
+{
+  TiledMatrix<T>* S = NewTiledMatrix<T>(ROWS, COLS, numThreads);
+
+  #pragma omp parallel for collapse(2) schedule(static) num_threads(numThreads)
+  for (int tr = 0; tr < S->TileRows; tr++)
+  {
+    for (int tc = 0; tc < S->TileCols; tc++)
+    {
+      T* tile = Tile(S, tr, tc);
+
+      int r0 = tr * TILE, rows = std::min(TILE, ROWS - r0);
+      int c0 = tc * TILE, cols = std::min(TILE, COLS - c0);
+
+      for (int r = 0; r < rows; r++)
+      {
+        const T* src = M[r0 + r] + c0;
+        T*       dst = tile + r * TILE;
+
+        #pragma omp simd
+        for (int c = 0; c < cols; c++)
+          dst[c] = src[c];
+      }
+    }
+  }
+
+  return S;
+}
+
+
+//
+// FromTiled: copies the tiled matrix S back into the dense matrix M, which
+// must be S->Rows x S->Cols. The padding is dropped.
+//
+template <class T>void FromTiled(const TiledMatrix<T>* S, T** M, int numThreads)
+{
+  #pragma omp parallel for collapse(2) schedule(static) num_threads(numThreads)
+  for (int tr = 0; tr < S->TileRows; tr++)
+  {
+    for (int tc = 0; tc < S->TileCols; tc++)
+    {
+      const T* tile = Tile(S, tr, tc);
+
+      int r0 = tr * TILE, rows = std::min(TILE, S->Rows - r0);
+      int c0 = tc * TILE, cols = std::min(TILE, S->Cols - c0);
+
+      for (int r = 0; r < rows; r++)
+      {
+        const T* src = tile + r * TILE;
+        T*       dst = M[r0 + r] + c0;
+
+        #pragma omp simd
+        for (int c = 0; c < cols; c++)
+          dst[c] = src[c];
+      }
+    }
+  }
+}
+
+
+//
+// DeleteTiledMatrix: returns memory associated with a tiled matrix returned
+// by NewTiledMatrix or ToTiled.
+//
+template <class T>void DeleteTiledMatrix(TiledMatrix<T>* S)
+{
+  delete[] S->TileIndex;
+  delete[] S->Elements;
+  delete S;
+}